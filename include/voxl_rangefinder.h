@@ -0,0 +1,168 @@
+/*******************************************************************************
+ * Copyright 2023 ModalAI Inc.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * 4. The Software is used solely in conjunction with devices provided by
+ *    ModalAI Inc.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ ******************************************************************************/
+
+
+#ifndef VOXL_RANGEFINDER_H
+#define VOXL_RANGEFINDER_H
+
+/**
+ * libvoxl_rangefinder
+ *
+ * Static library containing the rangefinder drivers, i2c multiplexer handling
+ * and the sampling loop used by voxl-rangefinder-server. Link against it to
+ * sample sensors directly in your own process without going through a pipe.
+ * Only one process can own the i2c bus so don't run this alongside
+ * voxl-rangefinder-server on the same sensors.
+ *
+ * typical usage:
+ *
+ *   rangefinder_ctx_t ctx;
+ *   rangefinder_ctx_init(&ctx, bus, 50, sensors, n_sensors);
+ *   rangefinder_open(&ctx);
+ *   rangefinder_start(&ctx);
+ *   while(running){
+ *       rangefinder_result_t res[RANGEFINDER_MAX_SENSORS];
+ *       int64_t t_ns;
+ *       rangefinder_sample(&ctx, res, &t_ns);
+ *   }
+ *   rangefinder_close(&ctx);
+ *
+ * All state lives in the context struct, including the i2c bus which is
+ * passed down to the driver on every call, so contexts on different buses
+ * are independent. The only global is the debug flag. The functions are not
+ * thread safe, use one thread per context.
+ */
+
+#include <stdint.h>
+#include <voxl_rangefinder_interface.h>
+
+
+#define RANGEFINDER_MAX_SENSORS	32
+
+
+// configuration of a single sensor
+typedef struct rangefinder_config_t{
+
+	int enabled;					///< a sensor is allowed to be listed and configured but disabled
+	int sensor_id;					///< ID of the rangefinder, must be unique
+	int type;						///< see voxl_rangefinder_interface.h
+
+	float fov_deg;					///< field of view of the sensor in degrees
+	float range_max_m;				///< Maximum range of the sensor in meters
+
+	float location_wrt_body[3];		///< location of the rangefinder with respect to body frame.
+	float direction_wrt_body[3];	///< direction vector of the rangefinder with respect to body frame
+
+	int is_on_mux;					// set non-zero to indicate this is connected through an i2c multiplexer
+	int i2c_mux_address;			// multiplexer address
+	int i2c_mux_port;				// 1-8
+
+} rangefinder_config_t;
+
+
+// everything we get out of one sensor for one sample
+typedef struct rangefinder_result_t{
+	int dist_mm;				///< distance, -1 if the reading was rejected
+	int sd_mm;					///< one standard deviation, -1 if rejected
+	uint8_t status;				///< reason for rejection, one of RANGEFINDER_STATUS_*
+	uint8_t range_status;		///< raw RESULT__RANGE_STATUS register value (low 5 bits), 255 if unknown
+	uint16_t signal_raw;		///< raw peak signal register used for rejection
+	float peak_signal_mcps;		///< peak signal count rate in MCPS
+	float ambient_mcps;			///< ambient count rate in MCPS
+	uint16_t effective_spads;	///< number of SPADs actually used for the reading
+	uint8_t signal_quality;		///< 0 unknown, 1 invalid, 2-100 from signal and ambient rates
+} rangefinder_result_t;
+
+
+// all the state for one bus worth of sensors
+typedef struct rangefinder_ctx_t{
+	int bus;						///< i2c bus number
+	int timing_budget_ms;			///< vl53l1x timing budget, one of 20, 33, 50, 100, 200, 500
+	int n_sensors;					///< number of sensors in the array below
+	rangefinder_config_t sensors[RANGEFINDER_MAX_SENSORS]; ///< enabled sensors only
+
+	// derived from the sensor list by rangefinder_ctx_init()
+	int has_nonmux_sensor;			///< one sensor not on the mux, moved to the secondary address
+	int n_mux_sensors;				///< number of sensors behind the mux
+	int mux_address;				///< i2c address of the mux
+
+	// runtime state
+	int is_open;
+	uint32_t sample_id;				///< incremented every rangefinder_sample()
+} rangefinder_ctx_t;
+
+
+// print debug info from the library and drivers
+void rangefinder_set_en_debug(int en);
+
+/**
+ * @brief      fill in a context from a list of sensors. Disabled sensors are
+ *             skipped. Does not touch hardware.
+ *
+ * @return     0 on success, -1 on invalid configuration
+ */
+int rangefinder_ctx_init(rangefinder_ctx_t* ctx, int bus, int timing_budget_ms,
+						const rangefinder_config_t* sensors, int n_sensors);
+
+/**
+ * @brief      open the i2c bus and initialize every sensor
+ *
+ * @return     0 on success, -1 on failure
+ */
+int rangefinder_open(rangefinder_ctx_t* ctx);
+
+/**
+ * @brief      start all sensors ranging, call right before the first
+ *             rangefinder_sample()
+ *
+ * @return     0 on success, -1 on failure
+ */
+int rangefinder_start(rangefinder_ctx_t* ctx);
+
+/**
+ * @brief      wait for the sensors to finish ranging then read all of them
+ *
+ * @param      ctx           context from rangefinder_open()
+ * @param[out] res           one result per sensor in ctx->sensors
+ * @param[out] timestamp_ns  middle of the ranging window in clock_monotonic
+ *
+ * @return     0 on success, -1 if any sensor had an i2c error. res is always
+ *             filled, with error values for sensors that failed.
+ */
+int rangefinder_sample(rangefinder_ctx_t* ctx, rangefinder_result_t* res, int64_t* timestamp_ns);
+
+// stop ranging and close the bus
+int rangefinder_close(rangefinder_ctx_t* ctx);
+
+
+#endif // VOXL_RANGEFINDER_H
@@ -0,0 +1,287 @@
+/*******************************************************************************
+ * Copyright 2023 ModalAI Inc.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * 4. The Software is used solely in conjunction with devices provided by
+ *    ModalAI Inc.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ ******************************************************************************/
+
+
+#ifndef VOXL_RANGEFINDER_CLIENT_HPP
+#define VOXL_RANGEFINDER_CLIENT_HPP
+
+/**
+ * Header-only C++ client for the rangefinders pipe.
+ *
+ * Wraps the usual pipe_client_set_simple_helper_cb() +
+ * voxl_rangefinder_parser_feed() boilerplate and keeps a lock-free latest
+ * sample slot per sensor_id. Optionally keeps the last HistoryLen valid samples
+ * of each sensor for interpolated lookups.
+ *
+ * Everything is allocated inside the object so no allocation happens after
+ * open() returns, it is safe to query from a control loop while the pipe
+ * thread is writing. Readers never block the writer, a read that races with a
+ * write just retries.
+ *
+ * typical usage:
+ *
+ *   static voxl_rangefinder::Client<64> rf;
+ *   rf.open("my-controller");
+ *   ...
+ *   rangefinder_data_t d;
+ *   if(rf.latest(0, &d)) ...
+ *   float dist_m;
+ *   if(rf.distance_at(2, t_ns, &dist_m)) ...
+ */
+
+#include <stdint.h>
+#include <string.h>
+#include <atomic>
+#include <modal_pipe_client.h>
+#include <voxl_rangefinder_interface.h>
+
+
+namespace voxl_rangefinder {
+
+
+// sensor_ids from 0 to this-1 are tracked, others are ignored
+static const int kMaxSensorId = 32;
+
+
+template <int HistoryLen = 0>
+class Client
+{
+public:
+
+	Client() : ch_(-1)
+	{
+		voxl_rangefinder_parser_init(&parser_);
+		for(int i=0; i<kMaxSensorId; i++){
+			latest_[i].seq.store(0, std::memory_order_relaxed);
+			latest_[i].valid = false;
+			hist_[i].seq.store(0, std::memory_order_relaxed);
+			hist_[i].head = 0;
+			hist_[i].count = 0;
+		}
+	}
+
+	~Client() { close(); }
+
+	/**
+	 * @brief      connect to the server, reconnects automatically
+	 *
+	 * @param[in]  client_name  name to identify ourselves with
+	 * @param[in]  pipe         pipe name or location, defaults to "rangefinders"
+	 *
+	 * @return     0 on success, MPA error code otherwise
+	 */
+	int open(const char* client_name, const char* pipe = RANGEFINDER_PIPE_LOCATION)
+	{
+		ch_ = pipe_client_get_next_available_channel();
+		if(ch_<0) return ch_;
+		pipe_client_set_simple_helper_cb(ch_, &Client::_helper_cb, this);
+		return pipe_client_open(ch_, pipe, client_name, \
+					EN_PIPE_CLIENT_SIMPLE_HELPER | EN_PIPE_CLIENT_AUTO_RECONNECT, \
+					RANGEFINDER_RECOMMENDED_READ_BUF_SIZE);
+	}
+
+	void close()
+	{
+		if(ch_>=0) pipe_client_close(ch_);
+		ch_ = -1;
+	}
+
+	/**
+	 * @brief      copy out the newest sample received for a sensor
+	 *
+	 * @return     false if nothing has been received for that sensor yet
+	 */
+	bool latest(int sensor_id, rangefinder_data_t* out) const
+	{
+		if(sensor_id<0 || sensor_id>=kMaxSensorId) return false;
+		const LatestSlot& s = latest_[sensor_id];
+		for(int i=0; i<100; i++){
+			uint32_t s1 = s.seq.load(std::memory_order_acquire);
+			if(s1 & 1) continue;
+			bool valid = s.valid;
+			memcpy(out, &s.data, sizeof(rangefinder_data_t));
+			std::atomic_thread_fence(std::memory_order_acquire);
+			if(s.seq.load(std::memory_order_relaxed)==s1) return valid;
+		}
+		return false;
+	}
+
+	/**
+	 * @brief      distance of a sensor at time t, linearly interpolated
+	 *             between the two valid samples either side of it. Only
+	 *             available when HistoryLen > 0.
+	 *
+	 * @param[in]  sensor_id  The sensor identifier
+	 * @param[in]  t_ns       time in clock_monotonic nanoseconds
+	 * @param[out] dist_m     interpolated distance in meters
+	 *
+	 * @return     false if t is outside of the history or there's no data
+	 */
+	bool distance_at(int sensor_id, int64_t t_ns, float* dist_m) const
+	{
+		if(HistoryLen<=0) return false;
+		if(sensor_id<0 || sensor_id>=kMaxSensorId) return false;
+		const History& h = hist_[sensor_id];
+
+		for(int tries=0; tries<100; tries++){
+			uint32_t s1 = h.seq.load(std::memory_order_acquire);
+			if(s1 & 1) continue;
+
+			bool found = false;
+			Entry a, b;
+			int n = h.count;
+			if(n>HistoryLen) n = HistoryLen;
+
+			// binary search for the first entry newer than t, oldest is index 0
+			int lo = 0, hi = n;
+			while(lo<hi){
+				int mid = (lo+hi)/2;
+				if(_at(h, n, mid).t_ns <= t_ns) lo = mid+1;
+				else hi = mid;
+			}
+			if(lo>0 && lo<n){
+				a = _at(h, n, lo-1);
+				b = _at(h, n, lo);
+				found = true;
+			}
+			else if(lo==n && n>0 && _at(h, n, n-1).t_ns==t_ns){
+				a = b = _at(h, n, n-1);
+				found = true;
+			}
+
+			std::atomic_thread_fence(std::memory_order_acquire);
+			if(h.seq.load(std::memory_order_relaxed)!=s1) continue;
+			if(!found) return false;
+
+			if(b.t_ns==a.t_ns){
+				*dist_m = a.dist_m;
+			}
+			else{
+				float frac = (float)(t_ns-a.t_ns)/(float)(b.t_ns-a.t_ns);
+				*dist_m = a.dist_m + frac*(b.dist_m-a.dist_m);
+			}
+			return true;
+		}
+		return false;
+	}
+
+	// parser counters, useful for spotting an overflowing pipe
+	uint64_t n_packets() const { return parser_.n_packets; }
+	uint64_t n_bytes_dropped() const { return parser_.n_bytes_dropped; }
+
+
+private:
+
+	struct LatestSlot{
+		std::atomic<uint32_t> seq;
+		bool valid;
+		rangefinder_data_t data;
+	};
+
+	struct Entry{
+		int64_t t_ns;
+		float dist_m;
+	};
+
+	struct History{
+		std::atomic<uint32_t> seq;
+		int head;		// next index to write
+		int count;		// number of entries written, saturates at HistoryLen
+		Entry e[HistoryLen > 0 ? HistoryLen : 1];
+	};
+
+	// i-th oldest of n entries
+	static const Entry& _at(const History& h, int n, int i)
+	{
+		int idx = h.head - n + i;
+		if(idx<0) idx += HistoryLen;
+		return h.e[idx];
+	}
+
+	void _write(const rangefinder_data_t& d)
+	{
+		if(d.sensor_id<0 || d.sensor_id>=kMaxSensorId) return;
+
+		LatestSlot& s = latest_[d.sensor_id];
+		uint32_t seq = s.seq.load(std::memory_order_relaxed);
+		s.seq.store(seq+1, std::memory_order_relaxed);
+		std::atomic_thread_fence(std::memory_order_release);
+		memcpy(&s.data, &d, sizeof(rangefinder_data_t));
+		s.valid = true;
+		s.seq.store(seq+2, std::memory_order_release);
+
+		// only valid readings go into the history, older than newest ignored
+		if(HistoryLen<=0 || d.distance_m<0.0f) return;
+		History& h = hist_[d.sensor_id];
+		if(h.count>0){
+			int last = h.head-1;
+			if(last<0) last += HistoryLen;
+			if(d.timestamp_ns<=h.e[last].t_ns) return;
+		}
+		seq = h.seq.load(std::memory_order_relaxed);
+		h.seq.store(seq+1, std::memory_order_relaxed);
+		std::atomic_thread_fence(std::memory_order_release);
+		h.e[h.head].t_ns = d.timestamp_ns;
+		h.e[h.head].dist_m = d.distance_m;
+		h.head = (h.head+1) % HistoryLen;
+		if(h.count<HistoryLen) h.count++;
+		h.seq.store(seq+2, std::memory_order_release);
+	}
+
+	static void _packets_cb(rangefinder_data_t* d, int n, void* context)
+	{
+		Client* c = static_cast<Client*>(context);
+		for(int i=0; i<n; i++) c->_write(d[i]);
+	}
+
+	static void _helper_cb(__attribute__((unused)) int ch, char* data, int bytes, void* context)
+	{
+		Client* c = static_cast<Client*>(context);
+		voxl_rangefinder_parser_feed(&c->parser_, data, bytes, &Client::_packets_cb, c);
+	}
+
+	int ch_;
+	rangefinder_stream_parser_t parser_;
+	LatestSlot latest_[kMaxSensorId];
+	History hist_[kMaxSensorId];
+
+	// not copyable, the pipe callback holds a pointer to us
+	Client(const Client&);
+	Client& operator=(const Client&);
+};
+
+
+} // namespace voxl_rangefinder
+
+
+#endif // VOXL_RANGEFINDER_CLIENT_HPP
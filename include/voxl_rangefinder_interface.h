@@ -36,6 +36,7 @@
 #define VOXL_RANGEFINDER_SERVER_PIPE_INTERFACE_H
 
 
+#include <string.h> // for memcpy in the streaming parser
 #include <modal_pipe_interfaces.h>
 #include <modal_pipe_common.h> // for MODAL_PIPE_DEFAULT_BASE_DIR
 
@@ -90,6 +91,15 @@ typedef struct rangefinder_data_t{
 } __attribute__((packed)) rangefinder_data_t;
 
 
+/**
+ * When en_per_sensor_pipes is set in the config file, the server also publishes
+ * each sensor's rangefinder_data_t on its own pipe named with this prefix
+ * followed by the sensor_id, e.g. "rangefinder_0". Subscribe to one of these
+ * if you only care about one sensor.
+ */
+#define RANGEFINDER_SENSOR_PIPE_PREFIX	"rangefinder_"
+
+
 /**
  * You don't have to use this read buffer size, but it is HIGHLY recommended to
  * use a multiple of the packet size so that you never read a partial packet
@@ -178,4 +188,750 @@ static inline rangefinder_data_t* voxl_rangefinder_validate_pipe_data(char* data
 
 
 
+
+////////////////////////////////////////////////////////////////////////////////
+// Streaming parser
+////////////////////////////////////////////////////////////////////////////////
+
+/**
+ * State for voxl_rangefinder_parser_feed(). Unlike
+ * voxl_rangefinder_validate_pipe_data() this tolerates partial packets and
+ * corrupted bytes. Partial packets are carried over to the next read and the
+ * stream is resynchronized by scanning for RANGEFINDER_MAGIC_NUMBER. Nothing
+ * is printed, check the counters instead.
+ *
+ * Zero-initialize it or call voxl_rangefinder_parser_init() before use.
+ */
+typedef struct rangefinder_stream_parser_t{
+	char     partial[sizeof(rangefinder_data_t)]; ///< start of a packet split across reads
+	int      n_partial;         ///< number of bytes in partial
+	uint64_t n_packets;         ///< total good packets returned
+	uint64_t n_bytes_dropped;   ///< total bytes discarded while resyncing
+	uint64_t n_resyncs;         ///< number of times we lost sync
+} rangefinder_stream_parser_t;
+
+
+/**
+ * Called by voxl_rangefinder_parser_feed() with a run of consecutive good
+ * packets. These point straight into the read buffer where possible so they
+ * must be consumed before returning, just like the validate function.
+ */
+typedef void (*rangefinder_parser_cb)(rangefinder_data_t* d, int n, void* context);
+
+
+static inline void voxl_rangefinder_parser_init(rangefinder_stream_parser_t* p)
+{
+	memset(p, 0, sizeof(rangefinder_stream_parser_t));
+}
+
+
+// true if the 4 bytes at ptr are the magic number, ptr need not be aligned
+static inline int __voxl_rangefinder_is_magic(const char* ptr)
+{
+	uint32_t m;
+	memcpy(&m, ptr, 4);
+	return m == RANGEFINDER_MAGIC_NUMBER;
+}
+
+
+// how many bytes at the end of the buffer could be the start of a magic number
+static inline int __voxl_rangefinder_magic_prefix_len(const char* ptr, int bytes)
+{
+	const uint32_t m = RANGEFINDER_MAGIC_NUMBER;
+	int n = bytes < 3 ? bytes : 3;
+	for(; n>0; n--){
+		if(memcmp(ptr+bytes-n, &m, n)==0) return n;
+	}
+	return 0;
+}
+
+
+// find the offset of the next magic number at or after ptr, or bytes if none
+// memchr is vectorized in libc so this only does a word compare on candidates
+static inline int __voxl_rangefinder_find_magic(const char* ptr, int bytes)
+{
+	const uint32_t m = RANGEFINDER_MAGIC_NUMBER;
+	const char first = ((const char*)&m)[0];
+	int pos = 0;
+	while(bytes-pos >= 4){
+		const char* c = (const char*)memchr(ptr+pos, first, bytes-pos-3);
+		if(c==NULL) break;
+		pos = c-ptr;
+		if(__voxl_rangefinder_is_magic(c)) return pos;
+		pos++;
+	}
+	return bytes;
+}
+
+
+/**
+ * @brief      Parse any number of bytes read from a rangefinders pipe.
+ *
+ *             Good packets are passed to cb in as few calls as possible, in
+ *             the common case of a clean aligned read that is one call with
+ *             the whole buffer and no copying. A packet split across two reads
+ *             is reassembled in the parser and passed on its own.
+ *
+ * @param      p        parser state, keep this between reads
+ * @param[in]  data     pipe read data buffer
+ * @param[in]  bytes    number of bytes in the buffer
+ * @param[in]  cb       called with each run of good packets
+ * @param      context  passed through to cb
+ *
+ * @return     number of good packets passed to cb
+ */
+static inline int voxl_rangefinder_parser_feed(rangefinder_stream_parser_t* p, char* data, int bytes, rangefinder_parser_cb cb, void* context)
+{
+	const int pkt = sizeof(rangefinder_data_t);
+	int pos = 0;
+	int n_out = 0;
+
+	if(data==NULL || bytes<=0) return 0;
+
+	// finish off a packet left over from the last read
+	if(p->n_partial>0){
+		int take = pkt - p->n_partial;
+		if(take>bytes) take = bytes;
+		int had = p->n_partial;
+		memcpy(p->partial+p->n_partial, data, take);
+		p->n_partial += take;
+
+		// we only save partials that look like the start of a magic number
+		// but if there were fewer than 4 bytes it may turn out not to be
+		if(p->n_partial>=4 && !__voxl_rangefinder_is_magic(p->partial)){
+			p->n_bytes_dropped += had;
+			p->n_resyncs++;
+			p->n_partial = 0;
+			// rescan the new data from the beginning
+		}
+		else if(p->n_partial<pkt){
+			return 0;
+		}
+		else{
+			cb((rangefinder_data_t*)p->partial, 1, context);
+			p->n_packets++;
+			p->n_partial = 0;
+			n_out++;
+			pos = take;
+		}
+	}
+
+	while(pos<bytes){
+		int remaining = bytes-pos;
+
+		if(remaining<4){
+			// might be the beginning of the next packet
+			int n = __voxl_rangefinder_magic_prefix_len(data+pos, remaining);
+			if(n==remaining){
+				memcpy(p->partial, data+pos, n);
+				p->n_partial = n;
+			}
+			else p->n_bytes_dropped += remaining;
+			break;
+		}
+
+		if(__voxl_rangefinder_is_magic(data+pos)){
+			// grab as many good packets in a row as we can
+			int run = 0;
+			int q = pos;
+			while(bytes-q>=pkt && __voxl_rangefinder_is_magic(data+q)){
+				run++;
+				q += pkt;
+			}
+			if(run>0){
+				cb((rangefinder_data_t*)(data+pos), run, context);
+				p->n_packets += run;
+				n_out += run;
+				pos = q;
+				continue;
+			}
+			// good start but not enough bytes, save it for next time
+			memcpy(p->partial, data+pos, remaining);
+			p->n_partial = remaining;
+			break;
+		}
+
+		// lost sync, skip ahead to the next magic number
+		int skip = 1 + __voxl_rangefinder_find_magic(data+pos+1, remaining-1);
+		if(skip>=remaining){
+			// no magic number found, keep anything that could be the start of one
+			int n = __voxl_rangefinder_magic_prefix_len(data+pos, remaining);
+			p->n_bytes_dropped += remaining-n;
+			p->n_resyncs++;
+			memcpy(p->partial, data+bytes-n, n);
+			p->n_partial = n;
+			break;
+		}
+		p->n_bytes_dropped += skip;
+		p->n_resyncs++;
+		pos += skip;
+	}
+
+	return n_out;
+}
+
+
+
+////////////////////////////////////////////////////////////////////////////////
+// Compact sample pipe
+////////////////////////////////////////////////////////////////////////////////
+
+#define RANGEFINDER_SAMPLE_PIPE_NAME		"rangefinder_samples"
+#define RANGEFINDER_SAMPLE_PIPE_LOCATION	(MODAL_PIPE_DEFAULT_BASE_DIR RANGEFINDER_SAMPLE_PIPE_NAME "/")
+
+/**
+ * Magic number for rangefinder_sample_t, different from RANGEFINDER_MAGIC_NUMBER
+ * so the two formats can never be confused for one another.
+ *
+ * spells "VOXS" in ASCII
+ */
+#define RANGEFINDER_SAMPLE_MAGIC_NUMBER (0x564F5853)
+
+// values for the 'status' field in rangefinder_sample_t
+#define RANGEFINDER_STATUS_VALID			0 ///< distance_mm is a good reading
+#define RANGEFINDER_STATUS_INVALID			1 ///< sensor failed to produce a usable reading
+#define RANGEFINDER_STATUS_OUT_OF_RANGE		2 ///< reading was beyond the configured range_max_m
+#define RANGEFINDER_STATUS_SIGMA_FAIL		3 ///< measurement sigma too large
+#define RANGEFINDER_STATUS_SIGNAL_FAIL		4 ///< return signal too weak
+#define RANGEFINDER_STATUS_MIN_RANGE		5 ///< target too close
+#define RANGEFINDER_STATUS_PHASE_OOB		6 ///< phase out of bounds
+#define RANGEFINDER_STATUS_HARDWARE_FAIL	7 ///< sensor reported a hardware failure
+#define RANGEFINDER_STATUS_WRAPPED_TARGET	8 ///< target beyond the unambiguous range
+#define RANGEFINDER_STATUS_PROCESSING_FAIL	9 ///< sensor internal processing failed
+#define RANGEFINDER_STATUS_NO_DATA			10 ///< failed to read the sensor at all
+#define RANGEFINDER_STATUS_TILT_LIMIT		11 ///< vehicle tilted too far for a height estimate
+#define RANGEFINDER_STATUS_NO_ATTITUDE		12 ///< no autopilot attitude near the sample time
+#define RANGEFINDER_STATUS_INCONSISTENT		13 ///< disagreed with an overlapping sensor, see consistency_reject
+
+/**
+ * Compact, naturally aligned rangefinder sample.
+ *
+ * This is published on the RANGEFINDER_SAMPLE_PIPE_NAME pipe alongside the
+ * legacy rangefinder_data_t pipe. It only contains the data that changes every
+ * sample. The static geometry of each sensor (fov, location, direction, max
+ * range, type) is published once in the pipe's info json under the "sensors"
+ * array. Each entry in that array contains the keys sensor_index, sensor_id,
+ * type, fov_deg, range_max_m, location_wrt_body, and direction_wrt_body.
+ * Use sensor_index to look up the geometry for a sample.
+ *
+ * totals 24 bytes with timestamp_ns on an 8-byte boundary
+ */
+typedef struct rangefinder_sample_t{
+	uint32_t magic_number;      ///< RANGEFINDER_SAMPLE_MAGIC_NUMBER
+	uint32_t sample_id;         ///< shared between sensors sampled at the same time
+	int64_t  timestamp_ns;      ///< Timestamp in clock_monotonic system time
+	int32_t  distance_mm;       ///< distance in millimeters, -1 if status is not valid
+	int16_t  uncertainty_mm;    ///< two standard deviations in mm, negative if unknown
+	uint8_t  status;            ///< one of RANGEFINDER_STATUS_*
+	uint8_t  sensor_index;      ///< index into the "sensors" array of the pipe info
+} rangefinder_sample_t;
+
+
+// 120 packets is less than one page of memory
+#define RANGEFINDER_SAMPLE_RECOMMENDED_READ_BUF_SIZE	(sizeof(rangefinder_sample_t) * 120)
+
+
+/**
+ * @brief      Same as voxl_rangefinder_validate_pipe_data() but for the
+ *             compact rangefinder_sample_t format. Does not copy any data.
+ *
+ * @param[in]  data       pointer to pipe read data buffer
+ * @param[in]  bytes      number of bytes read into that buffer
+ * @param[out] n_packets  number of valid packets received
+ *
+ * @return     Returns the same data pointer provided by the first argument, but
+ *             cast to an rangefinder_sample_t* struct for convenience. If there
+ *             was an error then NULL is returned and n_packets is set to 0
+ */
+static inline rangefinder_sample_t* voxl_rangefinder_validate_sample_pipe_data(char* data, int bytes, int* n_packets)
+{
+	rangefinder_sample_t* new_ptr = (rangefinder_sample_t*) data;
+	*n_packets = 0;
+
+	// basic sanity checks
+	if(bytes<0){
+		fprintf(stderr, "ERROR validating rangefinder samples received through pipe: number of bytes = %d\n", bytes);
+		return NULL;
+	}
+	if(data==NULL){
+		fprintf(stderr, "ERROR validating rangefinder samples received through pipe: got NULL data pointer\n");
+		return NULL;
+	}
+	if(bytes%sizeof(rangefinder_sample_t)){
+		fprintf(stderr, "ERROR validating rangefinder samples received through pipe: read partial packet\n");
+		fprintf(stderr, "read %d bytes, but it should be a multiple of %d\n", bytes, (int)sizeof(rangefinder_sample_t));
+		return NULL;
+	}
+
+	int n_packets_tmp = bytes/sizeof(rangefinder_sample_t);
+
+	// check if any packets failed the magic number check
+	int i, n_failed = 0;
+	for(i=0;i<n_packets_tmp;i++){
+		if(new_ptr[i].magic_number != RANGEFINDER_SAMPLE_MAGIC_NUMBER) n_failed++;
+	}
+	if(n_failed>0){
+		fprintf(stderr, "ERROR validating rangefinder samples received through pipe: %d of %d packets failed\n", n_failed, n_packets_tmp);
+		return NULL;
+	}
+
+	*n_packets = n_packets_tmp;
+	return new_ptr;
+}
+
+
+
+
+////////////////////////////////////////////////////////////////////////////////
+// Extended diagnostic sample pipe, optional, enable with en_extended_output
+////////////////////////////////////////////////////////////////////////////////
+
+#define RANGEFINDER_SAMPLE_EXT_PIPE_NAME		"rangefinder_samples_extended"
+#define RANGEFINDER_SAMPLE_EXT_PIPE_LOCATION	(MODAL_PIPE_DEFAULT_BASE_DIR RANGEFINDER_SAMPLE_EXT_PIPE_NAME "/")
+
+/**
+ * rangefinder_sample_t plus the diagnostics the sensor reports alongside each
+ * reading. These come out of the same register burst as the distance so they
+ * cost nothing extra on the bus. Fields are 0 for sensor types that don't
+ * report them. Use them to weight or reject readings yourself.
+ *
+ * The pipe info json contains the same "sensors" array as the compact pipe.
+ *
+ * totals 40 bytes
+ */
+typedef struct rangefinder_sample_ext_t{
+	rangefinder_sample_t sample;///< the regular compact sample
+	float    peak_signal_mcps;  ///< peak return signal rate in mega counts per second
+	float    ambient_mcps;      ///< ambient light count rate in mega counts per second
+	uint16_t effective_spads;   ///< number of SPADs that contributed to the reading
+	uint8_t  range_status;      ///< raw RESULT__RANGE_STATUS register value (low 5 bits), 255 if unknown
+	uint8_t  signal_quality;    ///< 0 unknown, 1 invalid, 2-100 as in MAVLink DISTANCE_SENSOR
+	uint8_t  reserved[4];       ///< pads the struct to a multiple of 8 bytes
+} rangefinder_sample_ext_t;
+
+
+#define RANGEFINDER_SAMPLE_EXT_RECOMMENDED_READ_BUF_SIZE	(sizeof(rangefinder_sample_ext_t) * 100)
+
+
+/**
+ * @brief      Same as voxl_rangefinder_validate_sample_pipe_data() but for
+ *             the rangefinder_sample_ext_t format. Does not copy any data.
+ */
+static inline rangefinder_sample_ext_t* voxl_rangefinder_validate_sample_ext_pipe_data(char* data, int bytes, int* n_packets)
+{
+	rangefinder_sample_ext_t* new_ptr = (rangefinder_sample_ext_t*) data;
+	*n_packets = 0;
+
+	if(bytes<0 || data==NULL){
+		fprintf(stderr, "ERROR validating extended rangefinder samples received through pipe\n");
+		return NULL;
+	}
+	if(bytes%sizeof(rangefinder_sample_ext_t)){
+		fprintf(stderr, "ERROR validating extended rangefinder samples received through pipe: read partial packet\n");
+		return NULL;
+	}
+
+	int i, n_packets_tmp = bytes/sizeof(rangefinder_sample_ext_t);
+	for(i=0;i<n_packets_tmp;i++){
+		if(new_ptr[i].sample.magic_number != RANGEFINDER_SAMPLE_MAGIC_NUMBER){
+			fprintf(stderr, "ERROR validating extended rangefinder samples received through pipe: bad magic number\n");
+			return NULL;
+		}
+	}
+
+	*n_packets = n_packets_tmp;
+	return new_ptr;
+}
+
+
+
+////////////////////////////////////////////////////////////////////////////////
+// Body-frame point cloud, optional, enable with en_point_cloud
+////////////////////////////////////////////////////////////////////////////////
+
+/**
+ * Standard MPA point cloud (point_cloud_metadata_t followed by float XYZ
+ * triplets) with one point per valid reading in body frame, meters. If
+ * en_point_cloud_cone_edges is set, 4 more points are added per reading at
+ * the same range along the edges of the sensor's field of view cone.
+ *
+ * Read with pipe_client_set_point_cloud_helper_cb()
+ */
+#define RANGEFINDER_POINT_CLOUD_PIPE_NAME		"rangefinder_point_cloud"
+#define RANGEFINDER_POINT_CLOUD_PIPE_LOCATION	(MODAL_PIPE_DEFAULT_BASE_DIR RANGEFINDER_POINT_CLOUD_PIPE_NAME "/")
+
+
+
+////////////////////////////////////////////////////////////////////////////////
+// Tilt-compensated height above ground, optional, enable with en_height
+////////////////////////////////////////////////////////////////////////////////
+
+#define RANGEFINDER_HEIGHT_PIPE_NAME		"rangefinder_height"
+#define RANGEFINDER_HEIGHT_PIPE_LOCATION	(MODAL_PIPE_DEFAULT_BASE_DIR RANGEFINDER_HEIGHT_PIPE_NAME "/")
+
+/**
+ * spells "VOXH" in ASCII
+ */
+#define RANGEFINDER_HEIGHT_MAGIC_NUMBER (0x564F5848)
+
+/**
+ * Height of the body origin above the ground, measured by one downward facing
+ * sensor. The reading is projected through the sensor's direction_wrt_body
+ * and location_wrt_body using autopilot roll and pitch interpolated to the
+ * sample time. One packet per downward sensor per sample.
+ *
+ * totals 40 bytes
+ */
+typedef struct rangefinder_height_t{
+	uint32_t magic_number;      ///< RANGEFINDER_HEIGHT_MAGIC_NUMBER
+	int32_t  sensor_id;         ///< sensor the height came from
+	int64_t  timestamp_ns;      ///< Timestamp in clock_monotonic system time
+	float    height_m;          ///< vertical height above ground, -1 if status is not valid
+	float    range_m;           ///< raw reading along the sensor ray, -1 if invalid
+	float    tilt_deg;          ///< angle between the sensor ray and straight down
+	float    roll_rad;          ///< attitude used for the projection
+	float    pitch_rad;         ///< attitude used for the projection
+	uint8_t  status;            ///< one of RANGEFINDER_STATUS_*
+	uint8_t  reserved[3];
+} rangefinder_height_t;
+
+
+#define RANGEFINDER_HEIGHT_RECOMMENDED_READ_BUF_SIZE	(sizeof(rangefinder_height_t) * 100)
+
+
+/**
+ * @brief      Same as voxl_rangefinder_validate_sample_pipe_data() but for
+ *             the rangefinder_height_t format. Does not copy any data.
+ */
+static inline rangefinder_height_t* voxl_rangefinder_validate_height_pipe_data(char* data, int bytes, int* n_packets)
+{
+	rangefinder_height_t* new_ptr = (rangefinder_height_t*) data;
+	*n_packets = 0;
+
+	if(bytes<0 || data==NULL){
+		fprintf(stderr, "ERROR validating rangefinder height received through pipe\n");
+		return NULL;
+	}
+	if(bytes%sizeof(rangefinder_height_t)){
+		fprintf(stderr, "ERROR validating rangefinder height received through pipe: read partial packet\n");
+		return NULL;
+	}
+
+	int i, n_packets_tmp = bytes/sizeof(rangefinder_height_t);
+	for(i=0;i<n_packets_tmp;i++){
+		if(new_ptr[i].magic_number != RANGEFINDER_HEIGHT_MAGIC_NUMBER){
+			fprintf(stderr, "ERROR validating rangefinder height received through pipe: bad magic number\n");
+			return NULL;
+		}
+	}
+
+	*n_packets = n_packets_tmp;
+	return new_ptr;
+}
+
+
+
+////////////////////////////////////////////////////////////////////////////////
+// IMU-aided height prediction, optional, enable with en_height_predictor
+////////////////////////////////////////////////////////////////////////////////
+
+#define RANGEFINDER_HEIGHT_PRED_PIPE_NAME		"rangefinder_height_predicted"
+#define RANGEFINDER_HEIGHT_PRED_PIPE_LOCATION	(MODAL_PIPE_DEFAULT_BASE_DIR RANGEFINDER_HEIGHT_PRED_PIPE_NAME "/")
+
+/**
+ * spells "VOXP" in ASCII
+ */
+#define RANGEFINDER_HEIGHT_PRED_MAGIC_NUMBER (0x564F5850)
+
+/**
+ * Height above ground propagated with the IMU between rangefinder samples and
+ * corrected by every valid rangefinder_height_t reading. Published at
+ * predictor_rate_hz. The standard deviations grow between corrections.
+ *
+ * totals 40 bytes
+ */
+typedef struct rangefinder_height_pred_t{
+	uint32_t magic_number;      ///< RANGEFINDER_HEIGHT_PRED_MAGIC_NUMBER
+	uint32_t n_updates;         ///< number of rangefinder readings fused so far
+	int64_t  timestamp_ns;      ///< time of the prediction in clock_monotonic, from the IMU
+	float    height_m;          ///< predicted height of the body origin above ground
+	float    vz_ms;             ///< vertical velocity, positive up
+	float    height_sd_m;       ///< one standard deviation of height_m
+	float    vz_sd_ms;          ///< one standard deviation of vz_ms
+	int64_t  last_update_ns;    ///< timestamp of the last fused rangefinder reading
+} rangefinder_height_pred_t;
+
+
+#define RANGEFINDER_HEIGHT_PRED_RECOMMENDED_READ_BUF_SIZE	(sizeof(rangefinder_height_pred_t) * 400)
+
+
+/**
+ * @brief      Same as voxl_rangefinder_validate_sample_pipe_data() but for
+ *             the rangefinder_height_pred_t format. Does not copy any data.
+ */
+static inline rangefinder_height_pred_t* voxl_rangefinder_validate_height_pred_pipe_data(char* data, int bytes, int* n_packets)
+{
+	rangefinder_height_pred_t* new_ptr = (rangefinder_height_pred_t*) data;
+	*n_packets = 0;
+
+	if(bytes<0 || data==NULL){
+		fprintf(stderr, "ERROR validating rangefinder height prediction received through pipe\n");
+		return NULL;
+	}
+	if(bytes%sizeof(rangefinder_height_pred_t)){
+		fprintf(stderr, "ERROR validating rangefinder height prediction received through pipe: read partial packet\n");
+		return NULL;
+	}
+
+	int i, n_packets_tmp = bytes/sizeof(rangefinder_height_pred_t);
+	for(i=0;i<n_packets_tmp;i++){
+		if(new_ptr[i].magic_number != RANGEFINDER_HEIGHT_PRED_MAGIC_NUMBER){
+			fprintf(stderr, "ERROR validating rangefinder height prediction received through pipe: bad magic number\n");
+			return NULL;
+		}
+	}
+
+	*n_packets = n_packets_tmp;
+	return new_ptr;
+}
+
+
+
+////////////////////////////////////////////////////////////////////////////////
+// Range rate and time to contact, optional, enable with en_range_rate
+////////////////////////////////////////////////////////////////////////////////
+
+#define RANGEFINDER_RANGE_RATE_PIPE_NAME		"rangefinder_range_rate"
+#define RANGEFINDER_RANGE_RATE_PIPE_LOCATION	(MODAL_PIPE_DEFAULT_BASE_DIR RANGEFINDER_RANGE_RATE_PIPE_NAME "/")
+
+/**
+ * spells "VOXR" in ASCII
+ */
+#define RANGEFINDER_RANGE_RATE_MAGIC_NUMBER (0x564F5852)
+
+/**
+ * Filtered distance and rate of change along each sensor's ray, one packet
+ * per sensor per sample. Invalid readings are skipped by the filter which
+ * coasts through short gaps and restarts after long ones. status is
+ * RANGEFINDER_STATUS_NO_DATA until the filter has seen a few readings.
+ *
+ * While coasting, status is the status of the current reading, so anything
+ * other than RANGEFINDER_STATUS_VALID means distance_m, distance_now_m and
+ * ttc_s are extrapolated from a reading age_ms old and should not be acted
+ * on as a fresh measurement.
+ *
+ * totals 48 bytes
+ */
+typedef struct rangefinder_range_rate_t{
+	uint32_t magic_number;      ///< RANGEFINDER_RANGE_RATE_MAGIC_NUMBER
+	uint32_t sample_id;         ///< sample_id of the reading this came from
+	int64_t  timestamp_ns;      ///< Timestamp in clock_monotonic system time
+	float    distance_m;        ///< filtered distance at timestamp_ns
+	float    range_rate_ms;     ///< rate of change of distance, negative when closing
+	float    ttc_s;             ///< time to contact, -1 if not closing
+	float    distance_now_m;    ///< distance extrapolated to now_ns
+	int64_t  now_ns;            ///< time distance_now_m refers to, see en_range_rate_latency_comp
+	int32_t  sensor_id;         ///< sensor this came from
+	uint8_t  status;            ///< status of the current reading, one of RANGEFINDER_STATUS_*
+	uint8_t  reserved;
+	uint16_t age_ms;            ///< timestamp_ns minus the time of the last valid reading, 0 when it's this one
+} rangefinder_range_rate_t;
+
+
+#define RANGEFINDER_RANGE_RATE_RECOMMENDED_READ_BUF_SIZE	(sizeof(rangefinder_range_rate_t) * 100)
+
+
+/**
+ * @brief      Same as voxl_rangefinder_validate_sample_pipe_data() but for
+ *             the rangefinder_range_rate_t format. Does not copy any data.
+ */
+static inline rangefinder_range_rate_t* voxl_rangefinder_validate_range_rate_pipe_data(char* data, int bytes, int* n_packets)
+{
+	rangefinder_range_rate_t* new_ptr = (rangefinder_range_rate_t*) data;
+	*n_packets = 0;
+
+	if(bytes<0 || data==NULL){
+		fprintf(stderr, "ERROR validating rangefinder range rate received through pipe\n");
+		return NULL;
+	}
+	if(bytes%sizeof(rangefinder_range_rate_t)){
+		fprintf(stderr, "ERROR validating rangefinder range rate received through pipe: read partial packet\n");
+		return NULL;
+	}
+
+	int i, n_packets_tmp = bytes/sizeof(rangefinder_range_rate_t);
+	for(i=0;i<n_packets_tmp;i++){
+		if(new_ptr[i].magic_number != RANGEFINDER_RANGE_RATE_MAGIC_NUMBER){
+			fprintf(stderr, "ERROR validating rangefinder range rate received through pipe: bad magic number\n");
+			return NULL;
+		}
+	}
+
+	*n_packets = n_packets_tmp;
+	return new_ptr;
+}
+
+
+
+////////////////////////////////////////////////////////////////////////////////
+// Filtered readings, optional, set filter on one or more sensors
+////////////////////////////////////////////////////////////////////////////////
+
+/**
+ * Same rangefinder_data_t packets as the main pipe but after each sensor's
+ * configured filter. Sensors with filter set to none pass through as-is.
+ * Readings dropped by the filter have distance_m set to -1.
+ */
+#define RANGEFINDER_FILTERED_PIPE_NAME		"rangefinder_filtered"
+#define RANGEFINDER_FILTERED_PIPE_LOCATION	(MODAL_PIPE_DEFAULT_BASE_DIR RANGEFINDER_FILTERED_PIPE_NAME "/")
+
+
+
+////////////////////////////////////////////////////////////////////////////////
+// Multi-sensor snapshots, optional, enable with frame_rate_hz
+////////////////////////////////////////////////////////////////////////////////
+
+#define RANGEFINDER_FRAME_PIPE_NAME		"rangefinder_frames"
+#define RANGEFINDER_FRAME_PIPE_LOCATION	(MODAL_PIPE_DEFAULT_BASE_DIR RANGEFINDER_FRAME_PIPE_NAME "/")
+
+/**
+ * spells "VOXF" in ASCII
+ */
+#define RANGEFINDER_FRAME_MAGIC_NUMBER (0x564F5846)
+
+#define RANGEFINDER_FRAME_MAX_SENSORS	32
+
+/**
+ * The latest reading from every sensor in one fixed-size record, published at
+ * frame_rate_hz regardless of how often each sensor is sampled. Arrays are
+ * indexed by sensor_index, the pipe info json has the same "sensors" array as
+ * the rangefinder_samples pipe to look up geometry.
+ *
+ * A sensor's bit in fresh_mask is set if it produced a new valid reading
+ * since the previous frame. Its bit in valid_mask is set if its latest valid
+ * reading is no older than frame_max_age_ms. Readings that are neither are
+ * still filled in with their age so consumers can decide for themselves.
+ *
+ * totals 384 bytes
+ */
+typedef struct rangefinder_frame_t{
+	uint32_t magic_number;      ///< RANGEFINDER_FRAME_MAGIC_NUMBER
+	uint32_t frame_id;          ///< incremented every frame
+	int64_t  timestamp_ns;      ///< time the frame was assembled, clock_monotonic
+	uint32_t fresh_mask;        ///< bit per sensor, new valid reading since the last frame
+	uint32_t valid_mask;        ///< bit per sensor, valid reading within frame_max_age_ms
+	uint8_t  n_sensors;         ///< number of entries used in the arrays below
+	uint8_t  reserved[7];
+	int32_t  distance_mm[RANGEFINDER_FRAME_MAX_SENSORS];    ///< latest valid reading, -1 if none yet
+	int16_t  uncertainty_mm[RANGEFINDER_FRAME_MAX_SENSORS]; ///< two standard deviations
+	uint32_t age_us[RANGEFINDER_FRAME_MAX_SENSORS];         ///< timestamp_ns minus the reading's time, UINT32_MAX if none yet
+	uint8_t  status[RANGEFINDER_FRAME_MAX_SENSORS];         ///< status of the most recent reading, valid or not
+} rangefinder_frame_t;
+
+
+#define RANGEFINDER_FRAME_RECOMMENDED_READ_BUF_SIZE	(sizeof(rangefinder_frame_t) * 16)
+
+
+/**
+ * @brief      Same as voxl_rangefinder_validate_sample_pipe_data() but for
+ *             the rangefinder_frame_t format. Does not copy any data.
+ */
+static inline rangefinder_frame_t* voxl_rangefinder_validate_frame_pipe_data(char* data, int bytes, int* n_packets)
+{
+	rangefinder_frame_t* new_ptr = (rangefinder_frame_t*) data;
+	*n_packets = 0;
+
+	if(bytes<0 || data==NULL){
+		fprintf(stderr, "ERROR validating rangefinder frame received through pipe\n");
+		return NULL;
+	}
+	if(bytes%sizeof(rangefinder_frame_t)){
+		fprintf(stderr, "ERROR validating rangefinder frame received through pipe: read partial packet\n");
+		return NULL;
+	}
+
+	int i, n_packets_tmp = bytes/sizeof(rangefinder_frame_t);
+	for(i=0;i<n_packets_tmp;i++){
+		if(new_ptr[i].magic_number != RANGEFINDER_FRAME_MAGIC_NUMBER){
+			fprintf(stderr, "ERROR validating rangefinder frame received through pipe: bad magic number\n");
+			return NULL;
+		}
+	}
+
+	*n_packets = n_packets_tmp;
+	return new_ptr;
+}
+
+
+
+////////////////////////////////////////////////////////////////////////////////
+// Hit points in the local frame, optional, enable with en_world_points
+////////////////////////////////////////////////////////////////////////////////
+
+#define RANGEFINDER_WORLD_POINT_PIPE_NAME		"rangefinder_world_points"
+#define RANGEFINDER_WORLD_POINT_PIPE_LOCATION	(MODAL_PIPE_DEFAULT_BASE_DIR RANGEFINDER_WORLD_POINT_PIPE_NAME "/")
+
+/**
+ * spells "VOXW" in ASCII
+ */
+#define RANGEFINDER_WORLD_POINT_MAGIC_NUMBER (0x564F5857)
+
+/**
+ * One valid reading as a point in the local (VIO) frame, using the body pose
+ * interpolated to timestamp_ns. Readings with no pose around their timestamp
+ * are not published.
+ *
+ * The covariance combines the range sigma along the ray with the spread
+ * across the fov cone, since the sensor can't tell where in the cone the
+ * target is. VIO pose uncertainty is not included.
+ *
+ * totals 64 bytes
+ */
+typedef struct rangefinder_world_point_t{
+	uint32_t magic_number;      ///< RANGEFINDER_WORLD_POINT_MAGIC_NUMBER
+	uint32_t sample_id;         ///< sample_id of the reading this came from
+	int64_t  timestamp_ns;      ///< Timestamp in clock_monotonic system time
+	float    xyz[3];            ///< hit point in the local frame, m
+	float    cov[6];            ///< upper triangle of the covariance xx xy xz yy yz zz, m^2
+	int32_t  sensor_id;         ///< sensor this came from
+	float    distance_m;        ///< range along the sensor's ray
+	uint8_t  reserved[4];
+} rangefinder_world_point_t;
+
+
+#define RANGEFINDER_WORLD_POINT_RECOMMENDED_READ_BUF_SIZE	(sizeof(rangefinder_world_point_t) * 100)
+
+
+/**
+ * @brief      Same as voxl_rangefinder_validate_sample_pipe_data() but for
+ *             the rangefinder_world_point_t format. Does not copy any data.
+ */
+static inline rangefinder_world_point_t* voxl_rangefinder_validate_world_point_pipe_data(char* data, int bytes, int* n_packets)
+{
+	rangefinder_world_point_t* new_ptr = (rangefinder_world_point_t*) data;
+	*n_packets = 0;
+
+	if(bytes<0 || data==NULL){
+		fprintf(stderr, "ERROR validating rangefinder world point received through pipe\n");
+		return NULL;
+	}
+	if(bytes%sizeof(rangefinder_world_point_t)){
+		fprintf(stderr, "ERROR validating rangefinder world point received through pipe: read partial packet\n");
+		return NULL;
+	}
+
+	int i, n_packets_tmp = bytes/sizeof(rangefinder_world_point_t);
+	for(i=0;i<n_packets_tmp;i++){
+		if(new_ptr[i].magic_number != RANGEFINDER_WORLD_POINT_MAGIC_NUMBER){
+			fprintf(stderr, "ERROR validating rangefinder world point received through pipe: bad magic number\n");
+			return NULL;
+		}
+	}
+
+	*n_packets = n_packets_tmp;
+	return new_ptr;
+}
+
+
+
 #endif // VOXL_RANGEFINDER_SERVER_PIPE_INTERFACE_H
@@ -0,0 +1,216 @@
+/*******************************************************************************
+ * Copyright 2023 ModalAI Inc.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * 4. The Software is used solely in conjunction with devices provided by
+ *    ModalAI Inc.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ ******************************************************************************/
+
+
+#ifndef VOXL_RANGEFINDER_SHM_H
+#define VOXL_RANGEFINDER_SHM_H
+
+/**
+ * Header-only reader for the "latest sample" shared memory segment published
+ * by voxl-rangefinder-server when en_shm_latest is set in its config file.
+ *
+ * The segment holds the newest rangefinder_sample_t for every enabled sensor,
+ * each protected by its own seqlock. This is for consumers that only ever
+ * want the newest reading, they can poll it from any thread with no syscalls
+ * and no pipe reader thread. It sits alongside the normal pipes.
+ *
+ * typical usage:
+ *
+ *   rangefinder_shm_t* shm = voxl_rangefinder_shm_open();
+ *   rangefinder_sample_t s;
+ *   if(shm && voxl_rangefinder_shm_read(shm, 0, &s)==0) ...
+ *   // every second or so, or when samples stop changing
+ *   shm = voxl_rangefinder_shm_reopen(shm);
+ *   voxl_rangefinder_shm_close(shm);
+ *
+ * Link with -lrt on older glibc.
+ */
+
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <errno.h>
+#include <signal.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <voxl_rangefinder_interface.h>
+
+
+#define RANGEFINDER_SHM_NAME			"/voxl_rangefinder_latest"
+#define RANGEFINDER_SHM_MAGIC_NUMBER	(0x564F584D) // "VOXM"
+#define RANGEFINDER_SHM_VERSION			1
+#define RANGEFINDER_SHM_MAX_SENSORS		32
+
+/**
+ * One sensor's latest sample. seq is odd while the server is writing to it.
+ * Each slot gets its own cache line so readers of one sensor don't contend
+ * with writes to another.
+ */
+typedef struct rangefinder_shm_slot_t{
+	uint32_t seq;                   ///< seqlock sequence number
+	uint32_t reserved;
+	rangefinder_sample_t sample;    ///< latest sample for this sensor
+} __attribute__((aligned(64))) rangefinder_shm_slot_t;
+
+
+typedef struct rangefinder_shm_t{
+	uint32_t magic_number;          ///< RANGEFINDER_SHM_MAGIC_NUMBER while the server is using the segment, 0 after it exits
+	uint32_t version;               ///< RANGEFINDER_SHM_VERSION
+	uint32_t n_sensors;             ///< number of valid slots
+	int32_t  server_pid;            ///< pid of the server that created the segment, see voxl_rangefinder_shm_is_live()
+	int32_t  sensor_id[RANGEFINDER_SHM_MAX_SENSORS]; ///< sensor_id of each slot
+	rangefinder_shm_slot_t slot[RANGEFINDER_SHM_MAX_SENSORS];
+} rangefinder_shm_t;
+
+
+/**
+ * @brief      map the shared memory segment read-only
+ *
+ * @return     pointer to the segment or NULL if the server hasn't created it
+ */
+static inline rangefinder_shm_t* voxl_rangefinder_shm_open(void)
+{
+	int fd = shm_open(RANGEFINDER_SHM_NAME, O_RDONLY, 0);
+	if(fd<0) return NULL;
+
+	void* ptr = mmap(NULL, sizeof(rangefinder_shm_t), PROT_READ, MAP_SHARED, fd, 0);
+	close(fd);
+	if(ptr==MAP_FAILED) return NULL;
+
+	rangefinder_shm_t* shm = (rangefinder_shm_t*)ptr;
+	if(__atomic_load_n(&shm->magic_number, __ATOMIC_ACQUIRE) != RANGEFINDER_SHM_MAGIC_NUMBER || \
+										shm->version != RANGEFINDER_SHM_VERSION){
+		fprintf(stderr, "ERROR rangefinder shared memory has wrong magic number or version\n");
+		munmap(ptr, sizeof(rangefinder_shm_t));
+		return NULL;
+	}
+	return shm;
+}
+
+
+static inline void voxl_rangefinder_shm_close(rangefinder_shm_t* shm)
+{
+	if(shm!=NULL) munmap((void*)shm, sizeof(rangefinder_shm_t));
+}
+
+
+/**
+ * @brief      check if the server that created this segment is still using it
+ *
+ *             The server unlinks the segment when it starts and exits, so a
+ *             reader that stays open across a server restart keeps mapping
+ *             the old segment, which never updates again. This makes a
+ *             syscall so call it every now and then, not on every read.
+ *
+ * @return     1 if the segment is live, 0 if it's stale and should be reopened
+ */
+static inline int voxl_rangefinder_shm_is_live(const rangefinder_shm_t* shm)
+{
+	// the server clears the magic number when it exits cleanly
+	if(__atomic_load_n(&shm->magic_number, __ATOMIC_ACQUIRE) != RANGEFINDER_SHM_MAGIC_NUMBER) return 0;
+	// and this catches one that crashed, EPERM just means it's another user's
+	if(kill(shm->server_pid, 0) && errno==ESRCH) return 0;
+	return 1;
+}
+
+
+/**
+ * @brief      swap a stale segment for the current one
+ *
+ * @param[in]  shm   segment from voxl_rangefinder_shm_open(), or NULL to
+ *                   retry an open that failed
+ *
+ * @return     shm if it's still live, otherwise the newly opened segment
+ *             (shm is closed), or NULL if the server isn't running
+ */
+static inline rangefinder_shm_t* voxl_rangefinder_shm_reopen(rangefinder_shm_t* shm)
+{
+	if(shm!=NULL && voxl_rangefinder_shm_is_live(shm)) return shm;
+	voxl_rangefinder_shm_close(shm);
+
+	shm = voxl_rangefinder_shm_open();
+	// a crashed server leaves its segment behind until the next one starts
+	if(shm!=NULL && !voxl_rangefinder_shm_is_live(shm)){
+		voxl_rangefinder_shm_close(shm);
+		return NULL;
+	}
+	return shm;
+}
+
+
+/**
+ * @brief      find the slot index for a sensor_id
+ *
+ * @return     index to pass to voxl_rangefinder_shm_read(), -1 if not found
+ */
+static inline int voxl_rangefinder_shm_find_sensor(const rangefinder_shm_t* shm, int sensor_id)
+{
+	uint32_t i;
+	for(i=0; i<shm->n_sensors && i<RANGEFINDER_SHM_MAX_SENSORS; i++){
+		if(shm->sensor_id[i]==sensor_id) return i;
+	}
+	return -1;
+}
+
+
+/**
+ * @brief      copy out the latest sample for one sensor without locking
+ *
+ * @param[in]  shm    segment from voxl_rangefinder_shm_open()
+ * @param[in]  index  slot index, 0 to n_sensors-1
+ * @param[out] out    latest sample
+ *
+ * @return     0 on success, -1 on bad index or if the writer kept us out
+ */
+static inline int voxl_rangefinder_shm_read(const rangefinder_shm_t* shm, int index, rangefinder_sample_t* out)
+{
+	if(index<0 || index>=(int)shm->n_sensors || index>=RANGEFINDER_SHM_MAX_SENSORS) return -1;
+	const rangefinder_shm_slot_t* slot = &shm->slot[index];
+
+	// the server only writes once per sample so this will basically never
+	// retry more than once, the limit is just so we can't spin forever
+	int i;
+	for(i=0; i<100; i++){
+		uint32_t s1 = __atomic_load_n(&slot->seq, __ATOMIC_ACQUIRE);
+		if(s1 & 1) continue;
+		memcpy(out, &slot->sample, sizeof(rangefinder_sample_t));
+		__atomic_thread_fence(__ATOMIC_ACQUIRE);
+		uint32_t s2 = __atomic_load_n(&slot->seq, __ATOMIC_RELAXED);
+		if(s1==s2) return 0;
+	}
+	return -1;
+}
+
+
+#endif // VOXL_RANGEFINDER_SHM_H
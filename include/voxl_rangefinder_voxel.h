@@ -0,0 +1,380 @@
+/*******************************************************************************
+ * Copyright 2023 ModalAI Inc.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * 4. The Software is used solely in conjunction with devices provided by
+ *    ModalAI Inc.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ ******************************************************************************/
+
+
+#ifndef VOXL_RANGEFINDER_VOXEL_H
+#define VOXL_RANGEFINDER_VOXEL_H
+
+/**
+ * Header-only reader for the local occupancy voxel map that
+ * voxl-rangefinder-server keeps in shared memory when en_voxel_map is set in
+ * its config file.
+ *
+ * The map is a fixed-size hash table of voxels in the local (VIO) frame.
+ * Each voxel holds occupancy log odds that decay toward zero (unknown) with
+ * time constant decay_tau_s after their last update, so obstacles that
+ * haven't been seen for a while are forgotten. A voxel lives within
+ * RANGEFINDER_VOXEL_MAX_PROBE slots of voxl_rangefinder_voxel_hash() and
+ * slots are never emptied, so lookups stop at the first unused slot. The
+ * whole table is protected by one seqlock, queries retry if the server
+ * wrote meanwhile.
+ *
+ * typical usage:
+ *
+ *   rangefinder_voxel_map_t* map = voxl_rangefinder_voxel_open();
+ *   float p[3] = {x, y, z}, hit[3], dist;
+ *   if(map && voxl_rangefinder_voxel_nearest(map, p, 2.0f, hit, &dist)==0) ...
+ *   // every second or so, or when queries keep failing
+ *   map = voxl_rangefinder_voxel_reopen(map);
+ *   voxl_rangefinder_voxel_close(map);
+ *
+ * Link with -lm, and -lrt on older glibc.
+ */
+
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+#include <errno.h>
+#include <sched.h>
+#include <signal.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+
+#define RANGEFINDER_VOXEL_SHM_NAME		"/voxl_rangefinder_voxels"
+#define RANGEFINDER_VOXEL_MAGIC_NUMBER	(0x564F5856) // "VOXV"
+#define RANGEFINDER_VOXEL_VERSION		1
+
+#define RANGEFINDER_VOXEL_FLAG_USED		1
+
+// slots checked from a voxel's home slot before the server evicts one
+#define RANGEFINDER_VOXEL_MAX_PROBE		16
+
+/**
+ * One cell, the center is at (index+0.5)*voxel_size_m in the local frame.
+ *
+ * totals 16 bytes
+ */
+typedef struct rangefinder_voxel_t{
+	int16_t  x;                     ///< cell index along local x
+	int16_t  y;                     ///< cell index along local y
+	int16_t  z;                     ///< cell index along local z
+	uint16_t flags;                 ///< RANGEFINDER_VOXEL_FLAG_*
+	float    log_odds;              ///< occupancy log odds as of t_ms
+	uint32_t t_ms;                  ///< time of the last update in ms after epoch_ns
+} rangefinder_voxel_t;
+
+
+typedef struct rangefinder_voxel_map_t{
+	uint32_t magic_number;          ///< RANGEFINDER_VOXEL_MAGIC_NUMBER while the server is using the segment, 0 after it exits
+	uint32_t version;               ///< RANGEFINDER_VOXEL_VERSION
+	uint32_t seq;                   ///< seqlock sequence number, odd while the server is writing
+	uint32_t n_cells;               ///< size of the cell table, a power of 2
+	int32_t  server_pid;            ///< pid of the server that created the segment, see voxl_rangefinder_voxel_is_live()
+	float    voxel_size_m;          ///< edge length of each cell
+	float    decay_tau_s;           ///< time constant log odds decay toward 0 with
+	float    occupied_log_odds;     ///< cells at or above this count as obstacles
+	int64_t  epoch_ns;              ///< clock_monotonic time that t_ms counts from
+	uint32_t n_used;                ///< number of cells holding a voxel
+	uint32_t reserved;
+	rangefinder_voxel_t cell[];     ///< n_cells entries
+} rangefinder_voxel_map_t;
+
+
+static inline size_t voxl_rangefinder_voxel_map_size(uint32_t n_cells)
+{
+	return sizeof(rangefinder_voxel_map_t) + n_cells*sizeof(rangefinder_voxel_t);
+}
+
+
+// home slot of a voxel before masking with n_cells-1
+static inline uint32_t voxl_rangefinder_voxel_hash(int x, int y, int z)
+{
+	return ((uint32_t)x*73856093u) ^ ((uint32_t)y*19349663u) ^ ((uint32_t)z*83492791u);
+}
+
+
+/**
+ * @brief      map the shared memory segment read-only
+ *
+ * @return     pointer to the segment or NULL if the server hasn't created it
+ */
+static inline rangefinder_voxel_map_t* voxl_rangefinder_voxel_open(void)
+{
+	int fd = shm_open(RANGEFINDER_VOXEL_SHM_NAME, O_RDONLY, 0);
+	if(fd<0) return NULL;
+
+	struct stat st;
+	if(fstat(fd, &st) || st.st_size < (off_t)sizeof(rangefinder_voxel_map_t)){
+		close(fd);
+		return NULL;
+	}
+	void* ptr = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+	close(fd);
+	if(ptr==MAP_FAILED) return NULL;
+
+	rangefinder_voxel_map_t* map = (rangefinder_voxel_map_t*)ptr;
+	if(__atomic_load_n(&map->magic_number, __ATOMIC_ACQUIRE) != RANGEFINDER_VOXEL_MAGIC_NUMBER || \
+				map->version != RANGEFINDER_VOXEL_VERSION || \
+				voxl_rangefinder_voxel_map_size(map->n_cells) > (size_t)st.st_size){
+		fprintf(stderr, "ERROR rangefinder voxel map has wrong magic number, version, or size\n");
+		munmap(ptr, st.st_size);
+		return NULL;
+	}
+	return map;
+}
+
+
+static inline void voxl_rangefinder_voxel_close(rangefinder_voxel_map_t* map)
+{
+	if(map!=NULL) munmap((void*)map, voxl_rangefinder_voxel_map_size(map->n_cells));
+}
+
+
+/**
+ * @brief      check if the server that created this segment is still using it
+ *
+ *             The server unlinks the segment when it starts and exits, so a
+ *             reader that stays open across a server restart keeps mapping
+ *             the old segment, which never updates again. This makes a
+ *             syscall so call it every now and then, not on every query.
+ *
+ * @return     1 if the segment is live, 0 if it's stale and should be reopened
+ */
+static inline int voxl_rangefinder_voxel_is_live(const rangefinder_voxel_map_t* map)
+{
+	// the server clears the magic number when it exits cleanly
+	if(__atomic_load_n(&map->magic_number, __ATOMIC_ACQUIRE) != RANGEFINDER_VOXEL_MAGIC_NUMBER) return 0;
+	// and this catches one that crashed, EPERM just means it's another user's
+	if(kill(map->server_pid, 0) && errno==ESRCH) return 0;
+	return 1;
+}
+
+
+/**
+ * @brief      swap a stale segment for the current one
+ *
+ * @param[in]  map   segment from voxl_rangefinder_voxel_open(), or NULL to
+ *                   retry an open that failed
+ *
+ * @return     map if it's still live, otherwise the newly opened segment
+ *             (map is closed), or NULL if the server isn't running
+ */
+static inline rangefinder_voxel_map_t* voxl_rangefinder_voxel_reopen(rangefinder_voxel_map_t* map)
+{
+	if(map!=NULL && voxl_rangefinder_voxel_is_live(map)) return map;
+	voxl_rangefinder_voxel_close(map);
+
+	map = voxl_rangefinder_voxel_open();
+	// a crashed server leaves its segment behind until the next one starts
+	if(map!=NULL && !voxl_rangefinder_voxel_is_live(map)){
+		voxl_rangefinder_voxel_close(map);
+		return NULL;
+	}
+	return map;
+}
+
+
+/**
+ * @brief      look up one voxel by cell index through the hash
+ *
+ *             Doesn't take the seqlock, use it between reading seq and
+ *             checking it again like voxl_rangefinder_voxel_nearest() does.
+ *
+ * @return     the cell or NULL if the voxel isn't in the map
+ */
+static inline const rangefinder_voxel_t* voxl_rangefinder_voxel_find(const rangefinder_voxel_map_t* map, \
+																	int x, int y, int z)
+{
+	uint32_t mask = map->n_cells-1;
+	uint32_t home = voxl_rangefinder_voxel_hash(x, y, z);
+	uint32_t k;
+	for(k=0; k<RANGEFINDER_VOXEL_MAX_PROBE; k++){
+		const rangefinder_voxel_t* c = &map->cell[(home+k)&mask];
+		if(!(c->flags & RANGEFINDER_VOXEL_FLAG_USED)) return NULL;
+		if(c->x==x && c->y==y && c->z==z) return c;
+	}
+	return NULL;
+}
+
+
+// true if a cell holds an obstacle at now_ms, now_ms counts from epoch_ns
+static inline int voxl_rangefinder_voxel_is_occupied(const rangefinder_voxel_map_t* map, \
+							const rangefinder_voxel_t* c, float now_ms, float inv_tau_ms)
+{
+	if(c->log_odds < map->occupied_log_odds) return 0;
+	float age_ms = now_ms - (float)c->t_ms;
+	if(age_ms<0.0f) age_ms = 0.0f;
+	return c->log_odds*expf(-age_ms*inv_tau_ms) >= map->occupied_log_odds;
+}
+
+
+// used by voxl_rangefinder_voxel_nearest(), check one cell of the search and
+// update the best hit so far
+static inline void voxl_rangefinder_voxel_try_cell(const rangefinder_voxel_map_t* map, const float p[3], \
+						int x, int y, int z, float now_ms, float inv_tau_ms, float* best_d2, \
+						float hit[3], int* found)
+{
+	float vs = map->voxel_size_m;
+	float cx = ((float)x+0.5f)*vs;
+	float cy = ((float)y+0.5f)*vs;
+	float cz = ((float)z+0.5f)*vs;
+	float d2 = (cx-p[0])*(cx-p[0]) + (cy-p[1])*(cy-p[1]) + (cz-p[2])*(cz-p[2]);
+	if(d2 >= *best_d2) return;
+
+	const rangefinder_voxel_t* c = voxl_rangefinder_voxel_find(map, x, y, z);
+	if(c==NULL || !voxl_rangefinder_voxel_is_occupied(map, c, now_ms, inv_tau_ms)) return;
+
+	*best_d2 = d2;
+	hit[0] = cx;
+	hit[1] = cy;
+	hit[2] = cz;
+	*found = 1;
+}
+
+
+// used by voxl_rangefinder_voxel_nearest(), give the server a chance to
+// finish its write before trying again
+static inline void voxl_rangefinder_voxel_backoff(int attempt)
+{
+	if(attempt<4){
+		sched_yield();
+		return;
+	}
+	struct timespec ts = {0, 100000};
+	nanosleep(&ts, NULL);
+}
+
+
+/**
+ * @brief      find the closest occupied voxel center to a point in the local
+ *             frame
+ *
+ *             Cells are looked up through the hash in shells of growing
+ *             distance around p, stopping as soon as no closer cell can
+ *             exist, so a nearby obstacle is found quickly and the cost is
+ *             bounded by the cells within max_dist_m. If that is more cells
+ *             than the table holds the table is scanned instead. Retries
+ *             with a short backoff while the server is writing, waiting at
+ *             most about 10ms.
+ *
+ * @param[in]  map         segment from voxl_rangefinder_voxel_open()
+ * @param[in]  p           query point in the local frame, m
+ * @param[in]  max_dist_m  ignore anything further than this
+ * @param[out] hit         center of the nearest occupied voxel
+ * @param[out] dist_m      distance from p to hit
+ *
+ * @return     0 if an obstacle was found, 1 if none within max_dist_m, -1 if
+ *             the server kept us out
+ */
+static inline int voxl_rangefinder_voxel_nearest(const rangefinder_voxel_map_t* map, \
+							const float p[3], float max_dist_m, float hit[3], float* dist_m)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	int64_t now_ns = (int64_t)ts.tv_sec*1000000000 + ts.tv_nsec;
+
+	float vs = map->voxel_size_m;
+	int px = (int)floorf(p[0]/vs);
+	int py = (int)floorf(p[1]/vs);
+	int pz = (int)floorf(p[2]/vs);
+
+	// p can be anywhere in its cell so a center n cells out is at least
+	// (n-0.5)*vs away
+	int r_max = (int)ceilf(max_dist_m/vs + 0.5f);
+	double side = 2.0*r_max + 1.0;
+	int scan = side*side*side > (double)map->n_cells;
+
+	int i, r, x, y, z, found;
+	uint32_t j;
+	float best_d2;
+
+	for(i=0; i<100; i++){
+		uint32_t s1 = __atomic_load_n(&map->seq, __ATOMIC_ACQUIRE);
+		if(s1 & 1){
+			voxl_rangefinder_voxel_backoff(i);
+			continue;
+		}
+
+		float now_ms = (float)((now_ns - map->epoch_ns)/1000000);
+		float inv_tau_ms = 1.0f/(map->decay_tau_s*1000.0f);
+		found = 0;
+		best_d2 = max_dist_m*max_dist_m;
+
+		if(scan){
+			for(j=0; j<map->n_cells; j++){
+				const rangefinder_voxel_t* c = &map->cell[j];
+				if(!(c->flags & RANGEFINDER_VOXEL_FLAG_USED)) continue;
+				if(c->log_odds < map->occupied_log_odds) continue;
+				voxl_rangefinder_voxel_try_cell(map, p, c->x, c->y, c->z, now_ms, \
+											inv_tau_ms, &best_d2, hit, &found);
+			}
+		}
+		else{
+			for(r=0; r<=r_max; r++){
+				float r_min_m = ((float)r-0.5f)*vs;
+				if(r>0 && r_min_m*r_min_m >= best_d2) break;
+
+				// the shell of cells exactly r away in the max norm
+				for(x=-r; x<=r; x++){
+					for(y=-r; y<=r; y++){
+						int edge = (x==-r || x==r || y==-r || y==r);
+						int dz = edge ? 1 : 2*r;
+						if(r==0) dz = 1;
+						for(z=-r; z<=r; z+=dz){
+							voxl_rangefinder_voxel_try_cell(map, p, px+x, py+y, pz+z, now_ms, \
+														inv_tau_ms, &best_d2, hit, &found);
+						}
+					}
+				}
+			}
+		}
+
+		__atomic_thread_fence(__ATOMIC_ACQUIRE);
+		uint32_t s2 = __atomic_load_n(&map->seq, __ATOMIC_RELAXED);
+		if(s1==s2){
+			if(!found) return 1;
+			*dist_m = sqrtf(best_d2);
+			return 0;
+		}
+		voxl_rangefinder_voxel_backoff(i);
+	}
+	return -1;
+}
+
+
+#endif // VOXL_RANGEFINDER_VOXEL_H
@@ -0,0 +1,324 @@
+/*******************************************************************************
+ * Copyright 2023 ModalAI Inc.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * 4. The Software is used solely in conjunction with devices provided by
+ *    ModalAI Inc.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ ******************************************************************************/
+
+
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <voxl_io/i2c.h>
+#include <voxl_rangefinder.h>
+
+#include "vl53l1x.h"
+#include "vl53l1x_registers.h"
+
+
+#define MUX_ALL		8
+#define MUX_NONE	-1
+
+
+static int en_debug = 0;
+
+
+void rangefinder_set_en_debug(int en)
+{
+	en_debug = en;
+	vl53l1x_set_en_debug(en);
+	return;
+}
+
+
+static int64_t _apps_time_monotonic_ns(void)
+{
+	struct timespec ts;
+	if(clock_gettime(CLOCK_MONOTONIC, &ts)){
+		fprintf(stderr,"ERROR calling clock_gettime\n");
+		return -1;
+	}
+	return (int64_t)ts.tv_sec*1000000000 + (int64_t)ts.tv_nsec;
+}
+
+
+int rangefinder_ctx_init(rangefinder_ctx_t* ctx, int bus, int timing_budget_ms,
+						const rangefinder_config_t* sensors, int n_sensors)
+{
+	memset(ctx, 0, sizeof(rangefinder_ctx_t));
+	ctx->bus = bus;
+	ctx->timing_budget_ms = timing_budget_ms;
+
+	if(n_sensors>RANGEFINDER_MAX_SENSORS){
+		fprintf(stderr, "ERROR in %s, got %d sensors but maximum number is %d\n", \
+								__FUNCTION__, n_sensors, RANGEFINDER_MAX_SENSORS);
+		return -1;
+	}
+
+	for(int i=0; i<n_sensors; i++){
+
+		// keep an array of just the enabled sensors to read from later
+		if(!sensors[i].enabled) continue;
+		ctx->sensors[ctx->n_sensors] = sensors[i];
+		ctx->n_sensors++;
+
+		// flag if we have an oddball sensor not on multiplexer
+		if(!sensors[i].is_on_mux){
+			ctx->has_nonmux_sensor = 1;
+			continue;
+		}
+
+		// make sure mux port is in 0-7
+		if(sensors[i].i2c_mux_port<0 || sensors[i].i2c_mux_port>7){
+			fprintf(stderr, "ERROR in %s, i2c_mux_port must be in 0-7\n", __FUNCTION__);
+			return -1;
+		}
+		ctx->n_mux_sensors++;
+		ctx->mux_address = sensors[i].i2c_mux_address;
+	}
+
+	return 0;
+}
+
+
+// this is for TCA9548A i2c multiplexer
+// TODO add support for multiple muxers in the future
+static int _set_multiplexer(rangefinder_ctx_t* ctx, int mux_ch, uint8_t addr)
+{
+	if(ctx->n_mux_sensors>0){
+
+		if(voxl_i2c_set_device_address(ctx->bus, ctx->mux_address)){
+			fprintf(stderr, "failed to set i2c slave config on bus %d, address %d\n",
+					ctx->bus, ctx->mux_address);
+			return -1;
+		}
+
+		// set bitmask for mux channels to open
+		uint8_t bitmask;
+		if(mux_ch>7){
+			bitmask = 0xFF;			// all
+			if(en_debug) printf("setting mux to all enabled\n");
+		}
+		else if(mux_ch<0){
+			bitmask = 0;			// none
+			if(en_debug) printf("setting mux to all off\n");
+		}
+		else{
+			bitmask = 1 << mux_ch;	// just one
+			if(en_debug) printf("setting mux to port %d only\n", mux_ch);
+		}
+
+		if(voxl_i2c_send_byte(ctx->bus, bitmask)){
+			fprintf(stderr, "failed to write to i2c multiplexer\n");
+			return -1;
+		}
+	}
+
+	// then put address back to the rangefinder
+	// this could be primary or secondary address
+	if(voxl_i2c_set_device_address(ctx->bus, addr)){
+		fprintf(stderr, "failed to set i2c slave config on bus %d, address %d\n",
+				ctx->bus, addr);
+		return -1;
+	}
+	return 0;
+}
+
+
+// point the bus at sensor i, through the mux or at the nonmux secondary address
+static int _select_sensor(rangefinder_ctx_t* ctx, int i)
+{
+	if(ctx->sensors[i].is_on_mux == 0){
+		if(ctx->n_mux_sensors>0){
+			return _set_multiplexer(ctx, MUX_NONE, VL53L1X_TOF_SECONDARY_ADDR);
+		}
+		return vl53l1x_set_bus_to_default_slave_address(ctx->bus);
+	}
+	return _set_multiplexer(ctx, ctx->sensors[i].i2c_mux_port, VL53L1X_TOF_DEFAULT_ADDR);
+}
+
+
+static int _init_all(rangefinder_ctx_t* ctx)
+{
+	// if we have a nonmux sensor alongside a mux, set it to the secondary address
+	if(ctx->has_nonmux_sensor && ctx->n_mux_sensors>0){
+		_set_multiplexer(ctx, MUX_NONE, VL53L1X_TOF_DEFAULT_ADDR);
+		if(vl53l1x_swap_to_secondary_address(ctx->bus)){
+			return -1;
+		}
+	}
+	else vl53l1x_set_bus_to_default_slave_address(ctx->bus);
+
+
+	// init all the sensors
+	for(int i=0;i<ctx->n_sensors;i++){
+
+		// set up non-multiplexed sensor
+		if(ctx->sensors[i].is_on_mux == 0){
+			printf("initializing non-multiplexed tof sensor id %d\n", \
+											ctx->sensors[i].sensor_id);
+			// only turn off mux if needed
+			if(ctx->n_mux_sensors>0 && _set_multiplexer(ctx, MUX_NONE, VL53L1X_TOF_SECONDARY_ADDR)){
+				fprintf(stderr, "failed to set slave\n");
+				return -1;
+			}
+		}
+		else{
+			printf("initializing multiplexed tof sensor id %d at mux port %d\n", ctx->sensors[i].sensor_id, ctx->sensors[i].i2c_mux_port);
+
+			if(_set_multiplexer(ctx, ctx->sensors[i].i2c_mux_port, VL53L1X_TOF_DEFAULT_ADDR)){
+				fprintf(stderr, "failed to set slave\n");
+				return -1;
+			}
+		}
+
+		// finally init the single sensor after much multiplexer logic
+		if(vl53l1x_init(ctx->bus, ctx->sensors[i].fov_deg, ctx->timing_budget_ms)){
+			fprintf(stderr, "Error initializing sensor %d\n", i);
+			return -1;
+		}
+	}
+
+	return 0;
+}
+
+
+// run the same command on the nonmux sensor and on all mux sensors at once
+static int _for_all(rangefinder_ctx_t* ctx, int (*func)(int bus))
+{
+	int ret = 0;
+
+	if(ctx->has_nonmux_sensor){
+		if(ctx->n_mux_sensors>0) _set_multiplexer(ctx, MUX_NONE, VL53L1X_TOF_SECONDARY_ADDR);
+		else vl53l1x_set_bus_to_default_slave_address(ctx->bus);
+		ret |= func(ctx->bus);
+	}
+	if(ctx->n_mux_sensors>0){
+		_set_multiplexer(ctx, MUX_ALL, VL53L1X_TOF_DEFAULT_ADDR);
+		ret |= func(ctx->bus);
+	}
+	return ret;
+}
+
+
+int rangefinder_open(rangefinder_ctx_t* ctx)
+{
+	printf("initializing i2c bus %d\n", ctx->bus);
+	// don't worry, we will be changing this address later
+	if(voxl_i2c_init(ctx->bus, VL53L1X_TOF_DEFAULT_ADDR)){
+		fprintf(stderr, "failed to init bus\n");
+		return -1;
+	}
+	ctx->is_open = 1;
+
+	// let sensors wake up, todo check if this is needed
+	usleep(10000);
+
+	if(_init_all(ctx)) return -1;
+	if(en_debug) printf("finished initializing %d vl53l1x sensors\n", ctx->n_sensors);
+
+	return 0;
+}
+
+
+int rangefinder_start(rangefinder_ctx_t* ctx)
+{
+	// start all the multiplexed sensors reading at the same time
+	if(_for_all(ctx, vl53l1x_start_ranging)){
+		fprintf(stderr, "failed to start ranging\n");
+		return -1;
+	}
+	if(_for_all(ctx, vl53l1x_clear_interrupt)){
+		fprintf(stderr, "failed to clear interrupt\n");
+	}
+	return 0;
+}
+
+
+int rangefinder_sample(rangefinder_ctx_t* ctx, rangefinder_result_t* res, int64_t* timestamp_ns)
+{
+	int64_t read_time_ns = 0; // set after we read the interrupt
+	int had_error = 0;
+
+	// sleep a bit while they range, this usually take a little more time
+	// than the timing budget.
+	usleep((ctx->timing_budget_ms*1000)+8000);
+
+	if(en_debug) printf("---------------------------\n");
+
+	// now start reading the data back in
+	for(int i=0;i<ctx->n_sensors;i++){
+
+		// switch i2c bus and multiplexer over to either a multiplexed or non-multiplexed sensor
+		had_error |= _select_sensor(ctx, i);
+
+		// only for the first sensor, wait for it to be done ranging
+		if(i==0){
+			if(vl53l1x_wait_for_data(ctx->bus)){
+				fprintf(stderr, "WARNING sensor %d failed to report new data\n", i);
+				had_error |= -1;
+			}
+			read_time_ns = _apps_time_monotonic_ns();
+			// clear interrupt on first sensor so it's clear next time we start polling
+			had_error |= vl53l1x_clear_interrupt(ctx->bus);
+		}
+
+		// read in the data, this sets error values in res if there is an issue
+		had_error |= vl53l1x_get_result(ctx->bus, &res[i]);
+	}
+
+	// here is where we used to clear the interrupt on all sensors
+	// now we only do the first one since we only wait for the data ready
+	// flag on the first one. TODO maybe do this one in a while along with a
+	// stop and start ranging call to get them all back in sync
+
+	// assume timestamp of data was from halfway through the reading process
+	*timestamp_ns = read_time_ns - (ctx->timing_budget_ms*500000);
+	ctx->sample_id++;
+
+	return had_error ? -1 : 0;
+}
+
+
+int rangefinder_close(rangefinder_ctx_t* ctx)
+{
+	if(!ctx->is_open) return 0;
+
+	if(_for_all(ctx, vl53l1x_stop_ranging)){
+		fprintf(stderr, "WARNING failed to stop ranging\n");
+	}
+	if(voxl_i2c_close(ctx->bus)){
+		fprintf(stderr, "failed to close bus\n");
+		return -1;
+	}
+	ctx->is_open = 0;
+	return 0;
+}
@@ -33,16 +33,21 @@
 
 
 #include <stdio.h>
+#include <math.h>
 #include <stdint.h>
 #include <unistd.h>
 #include <voxl_io/i2c.h>
+#include <voxl_rangefinder_interface.h>
 #include "vl53l1x_registers.h"
 #include "vl53l1x.h"
-#include "config_file.h" // for bus global variable
 
 
 #define VL53L1X_LOWEST_ACCEPTABLE_SIGNAL 5
 
+// signal quality scales logarithmically between these peak signal rates
+#define VL53L1X_QUALITY_MIN_MCPS	0.04f
+#define VL53L1X_QUALITY_MAX_MCPS	40.0f
+
 static int en_debug = 0;
 
 
@@ -158,12 +163,12 @@ static uint32_t _reverse_lsb_msb_16(uint16_t reg)
 
 
 
-static int vl53l1x_write_reg_byte(uint16_t reg, uint8_t data)
+static int vl53l1x_write_reg_byte(int bus, uint16_t reg, uint8_t data)
 {
 	return voxl_i2c_reg16_write_bytes(bus, _reverse_lsb_msb_16(reg), 1, &data);
 }
 
-static int vl53l1x_write_reg_word(uint16_t reg, uint16_t data)
+static int vl53l1x_write_reg_word(int bus, uint16_t reg, uint16_t data)
 {
 	uint8_t buf[2];
 	buf[0] = data >> 8;
@@ -171,7 +176,7 @@ static int vl53l1x_write_reg_word(uint16_t reg, uint16_t data)
 	return voxl_i2c_reg16_write_bytes(bus, _reverse_lsb_msb_16(reg), 2, buf);
 }
 
-static int vl53l1x_write_reg_int(uint16_t reg, uint32_t data)
+static int vl53l1x_write_reg_int(int bus, uint16_t reg, uint32_t data)
 {
 	uint8_t buf[4];
 	buf[0] = (data >> 24) & 0xFF;
@@ -182,7 +187,7 @@ static int vl53l1x_write_reg_int(uint16_t reg, uint32_t data)
 }
 
 
-static int vl53l1x_read_reg_bytes(uint16_t reg, uint8_t* data, int bytes)
+static int vl53l1x_read_reg_bytes(int bus, uint16_t reg, uint8_t* data, int bytes)
 {
 	int ret;
 	ret = voxl_i2c_reg16_read_bytes(bus, _reverse_lsb_msb_16(reg), bytes, data);
@@ -190,7 +195,7 @@ static int vl53l1x_read_reg_bytes(uint16_t reg, uint8_t* data, int bytes)
 	return 0;
 }
 
-static int vl53l1x_read_reg_byte(uint16_t reg, uint8_t* data)
+static int vl53l1x_read_reg_byte(int bus, uint16_t reg, uint8_t* data)
 {
 	int ret;
 	ret = voxl_i2c_reg16_read_bytes(bus, _reverse_lsb_msb_16(reg), 1, data);
@@ -199,7 +204,7 @@ static int vl53l1x_read_reg_byte(uint16_t reg, uint8_t* data)
 }
 
 
-static int vl53l1x_read_reg_word(uint16_t reg, uint16_t* data)
+static int vl53l1x_read_reg_word(int bus, uint16_t reg, uint16_t* data)
 {
 	int ret;
 	uint8_t buf[2];
@@ -210,32 +215,32 @@ static int vl53l1x_read_reg_word(uint16_t reg, uint16_t* data)
 }
 
 
-static int vl53l1x_set_address(uint8_t addr)
+static int vl53l1x_set_address(int bus, uint8_t addr)
 {
-	return vl53l1x_write_reg_byte(VL53L1_I2C_SLAVE__DEVICE_ADDRESS, addr);
+	return vl53l1x_write_reg_byte(bus, VL53L1_I2C_SLAVE__DEVICE_ADDRESS, addr);
 }
 
 
-int vl53l1x_start_ranging(void)
+int vl53l1x_start_ranging(int bus)
 {
-	return vl53l1x_write_reg_byte(SYSTEM__MODE_START, 0x40); /* Enable VL53L1X */
+	return vl53l1x_write_reg_byte(bus, SYSTEM__MODE_START, 0x40); /* Enable VL53L1X */
 }
 
-int vl53l1x_stop_ranging(void)
+int vl53l1x_stop_ranging(int bus)
 {
-	return vl53l1x_write_reg_byte(SYSTEM__MODE_START, 0x00); /* Disable VL53L1X */
+	return vl53l1x_write_reg_byte(bus, SYSTEM__MODE_START, 0x00); /* Disable VL53L1X */
 }
 
-int vl53l1x_clear_interrupt(void)
+int vl53l1x_clear_interrupt(int bus)
 {
-	return vl53l1x_write_reg_byte(SYSTEM__INTERRUPT_CLEAR, 0x01);
+	return vl53l1x_write_reg_byte(bus, SYSTEM__INTERRUPT_CLEAR, 0x01);
 }
 
-int vl53l1x_check_for_data_ready(uint8_t *isDataReady)
+int vl53l1x_check_for_data_ready(int bus, uint8_t *isDataReady)
 {
 	uint8_t Temp;
 
-	if(vl53l1x_read_reg_byte(GPIO__TIO_HV_STATUS, &Temp)){
+	if(vl53l1x_read_reg_byte(bus, GPIO__TIO_HV_STATUS, &Temp)){
 		return -1;
 	}
 
@@ -287,17 +292,58 @@ static void _print_status(uint8_t status)
 }
 
 
-int vl53l1x_get_distance_mm(int* dist_mm, int* sd)
+// convert an ST range status into one of our own RANGEFINDER_STATUS_* values
+static uint8_t _status_to_rangefinder_status(uint8_t status)
+{
+	switch(status){
+		case 0:		return RANGEFINDER_STATUS_VALID;
+		case 1:		return RANGEFINDER_STATUS_SIGMA_FAIL;
+		case 2:		return RANGEFINDER_STATUS_SIGNAL_FAIL;
+		case 3:		return RANGEFINDER_STATUS_MIN_RANGE;
+		case 4:		return RANGEFINDER_STATUS_PHASE_OOB;
+		case 5:		return RANGEFINDER_STATUS_HARDWARE_FAIL;
+		case 7:		return RANGEFINDER_STATUS_WRAPPED_TARGET;
+		case 8:		return RANGEFINDER_STATUS_PROCESSING_FAIL;
+		default:	return RANGEFINDER_STATUS_INVALID;
+	}
+}
+
+
+// map signal and ambient rate of a valid reading to 2-100, leaving 0 and 1
+// for unknown and invalid like MAVLink does
+static uint8_t _signal_quality(float peak_mcps, float ambient_mcps)
 {
-	// set outputs to -1 so we can quit right away on error
-	*dist_mm = -1000;
-	*sd = -1;
+	if(peak_mcps <= VL53L1X_QUALITY_MIN_MCPS) return 2;
+
+	float q = logf(peak_mcps/VL53L1X_QUALITY_MIN_MCPS) / \
+			logf(VL53L1X_QUALITY_MAX_MCPS/VL53L1X_QUALITY_MIN_MCPS);
+	// ambient light adds shot noise to the return signal
+	q *= peak_mcps / (peak_mcps + ambient_mcps);
+
+	int ret = 2 + (int)(q*98.0f);
+	if(ret>100) ret = 100;
+	return ret;
+}
+
+
+int vl53l1x_get_result(int bus, rangefinder_result_t* res)
+{
+	// set outputs to error values so we can quit right away on error
+	res->dist_mm			= -1;
+	res->sd_mm				= -1;
+	res->status				= RANGEFINDER_STATUS_NO_DATA;
+	res->range_status		= 255;
+	res->signal_raw			= 0;
+	res->peak_signal_mcps	= 0.0f;
+	res->ambient_mcps		= 0.0f;
+	res->effective_spads	= 0;
+	res->signal_quality		= 0;
 
 	// one-shot read of all data
 	static const uint16_t base = VL53L1_RESULT__INTERRUPT_STATUS;
 	static const uint8_t n_bytes = 16; // up to the corrected range_mm register
 	uint8_t all_data[n_bytes];
-	if(vl53l1x_read_reg_bytes(VL53L1_RESULT__INTERRUPT_STATUS, all_data, n_bytes)){
+	if(vl53l1x_read_reg_bytes(bus, VL53L1_RESULT__INTERRUPT_STATUS, all_data, n_bytes)){
 		fprintf(stderr, "ERROR bulk reading status\n");
 		return -1;
 	}
@@ -311,6 +357,7 @@ int vl53l1x_get_distance_mm(int* dist_mm, int* sd)
 				255, 255, 9, 13, 255, 255, 255, 255, 10, 6,
 				255, 255, 11, 12 };
 	if(status_raw < 24) status = status_rtn[status_raw];
+	res->range_status = status_raw;
 
 	// range
 	int offset = VL53L1_RESULT__FINAL_CROSSTALK_CORRECTED_RANGE_MM_SD0-base;
@@ -324,9 +371,19 @@ int vl53l1x_get_distance_mm(int* dist_mm, int* sd)
 	// range_mm /= 0x0800;
 	// *dist_mm = range_mm;
 
-	// read signal strength
+	// read signal strength, register is MCPS in 9.7 fixed point
 	offset = VL53L1_RESULT__PEAK_SIGNAL_COUNT_RATE_MCPS_SD0 - base;
 	uint16_t signal = (all_data[offset]<<8) + all_data[offset+1];
+	res->signal_raw = signal;
+	res->peak_signal_mcps = (float)signal / 128.0f;
+
+	// ambient rate, also 9.7 fixed point MCPS
+	offset = VL53L1_RESULT__AMBIENT_COUNT_RATE_MCPS_SD0 - base;
+	res->ambient_mcps = (float)((all_data[offset]<<8) + all_data[offset+1]) / 128.0f;
+
+	// effective SPAD count is 8.8 fixed point, keep the integer part
+	offset = VL53L1_RESULT__DSS_ACTUAL_EFFECTIVE_SPADS_SD0 - base;
+	res->effective_spads = all_data[offset];
 
 	offset = VL53L1_RESULT__SIGMA_SD0 - base;
 	uint16_t sigma_mm = (all_data[offset]<<8) + all_data[offset+1];
@@ -341,27 +398,52 @@ int vl53l1x_get_distance_mm(int* dist_mm, int* sd)
 	}
 
 
+	// anything from here on is read but invalid unless it passes all checks
+	res->signal_quality = 1;
+
 	// allow "good" and "low signal" readings through, we check signal strength ourselves
-	if(status!=0 && status!=2) return 0;
+	if(status!=0 && status!=2){
+		res->status = _status_to_rangefinder_status(status);
+		return 0;
+	}
 
 	// Sensor reads uint16_max sometimes on bad readings, discard these too
-	if(dist_mm_raw > 8000) return 0;
+	if(dist_mm_raw > 8000){
+		res->status = RANGEFINDER_STATUS_INVALID;
+		return 0;
+	}
 
 	// signal == 0 is definitely a bad reading. also drop borderline values
-	if(signal < VL53L1X_LOWEST_ACCEPTABLE_SIGNAL) return 0;
+	if(signal < VL53L1X_LOWEST_ACCEPTABLE_SIGNAL){
+		res->status = RANGEFINDER_STATUS_SIGNAL_FAIL;
+		return 0;
+	}
 
-	*dist_mm = dist_mm_raw;
-	*sd = sigma_mm;
+	res->dist_mm = dist_mm_raw;
+	res->sd_mm = sigma_mm;
+	res->status = RANGEFINDER_STATUS_VALID;
+	res->signal_quality = _signal_quality(res->peak_signal_mcps, res->ambient_mcps);
 
 	return 0;
 }
 
 
-int vl53l1x_check_whoami(int quiet)
+int vl53l1x_get_distance_mm(int bus, int* dist_mm, int* sd)
+{
+	rangefinder_result_t res;
+	int ret = vl53l1x_get_result(bus, &res);
+	*dist_mm = res.dist_mm;
+	*sd = res.sd_mm;
+	if(res.status != RANGEFINDER_STATUS_VALID) *dist_mm = -1000;
+	return ret;
+}
+
+
+int vl53l1x_check_whoami(int bus, int quiet)
 {
 	//read WHOAMI register
 	uint16_t id;
-	int ret = vl53l1x_read_reg_word(VL53L1_IDENTIFICATION__MODEL_ID, &id);
+	int ret = vl53l1x_read_reg_word(bus, VL53L1_IDENTIFICATION__MODEL_ID, &id);
 	if(ret<0){
 		if(!quiet){
 			fprintf(stderr, "ERROR in %s, failed to read whoami register\n", __FUNCTION__);
@@ -382,9 +464,9 @@ int vl53l1x_check_whoami(int quiet)
 
 
 // argument is the index of this sensor in the enabled_sensors array
-int vl53l1x_init(float fov_deg, int TimingBudgetInMs)
+int vl53l1x_init(int bus, float fov_deg, int TimingBudgetInMs)
 {
-	if(vl53l1x_check_whoami(0)){
+	if(vl53l1x_check_whoami(bus, 0)){
 		fprintf(stderr, "ERROR in %s, failed to verify whoami\n", __FUNCTION__);
 		return -1;
 	}
@@ -395,43 +477,43 @@ int vl53l1x_init(float fov_deg, int TimingBudgetInMs)
 	// load in default settings
 	uint8_t Addr = 0x00;
 	for (Addr = 0x2D; Addr <= 0x87; Addr++){
-		vl53l1x_write_reg_byte(Addr, VL51L1X_DEFAULT_CONFIGURATION[Addr - 0x2D]);
+		vl53l1x_write_reg_byte(bus, Addr, VL51L1X_DEFAULT_CONFIGURATION[Addr - 0x2D]);
 	}
 
 	// set to long distance mode
-	vl53l1x_write_reg_byte(PHASECAL_CONFIG__TIMEOUT_MACROP, 0x0A);
-	vl53l1x_write_reg_byte(RANGE_CONFIG__VCSEL_PERIOD_A, 0x0F);
-	vl53l1x_write_reg_byte(RANGE_CONFIG__VCSEL_PERIOD_B, 0x0D);
-	vl53l1x_write_reg_byte(RANGE_CONFIG__VALID_PHASE_HIGH, 0xB8);
-	vl53l1x_write_reg_word(SD_CONFIG__WOI_SD0, 0x0F0D);
-	vl53l1x_write_reg_word(SD_CONFIG__INITIAL_PHASE_SD0, 0x0E0E);
+	vl53l1x_write_reg_byte(bus, PHASECAL_CONFIG__TIMEOUT_MACROP, 0x0A);
+	vl53l1x_write_reg_byte(bus, RANGE_CONFIG__VCSEL_PERIOD_A, 0x0F);
+	vl53l1x_write_reg_byte(bus, RANGE_CONFIG__VCSEL_PERIOD_B, 0x0D);
+	vl53l1x_write_reg_byte(bus, RANGE_CONFIG__VALID_PHASE_HIGH, 0xB8);
+	vl53l1x_write_reg_word(bus, SD_CONFIG__WOI_SD0, 0x0F0D);
+	vl53l1x_write_reg_word(bus, SD_CONFIG__INITIAL_PHASE_SD0, 0x0E0E);
 
 
 	switch(TimingBudgetInMs)
 	{
 		case 20:
-			vl53l1x_write_reg_word(RANGE_CONFIG__TIMEOUT_MACROP_A_HI,0x001E);
-			vl53l1x_write_reg_word(RANGE_CONFIG__TIMEOUT_MACROP_B_HI,0x0022);
+			vl53l1x_write_reg_word(bus, RANGE_CONFIG__TIMEOUT_MACROP_A_HI,0x001E);
+			vl53l1x_write_reg_word(bus, RANGE_CONFIG__TIMEOUT_MACROP_B_HI,0x0022);
 			break;
 		case 33:
-			vl53l1x_write_reg_word(RANGE_CONFIG__TIMEOUT_MACROP_A_HI,0x0060);
-			vl53l1x_write_reg_word(RANGE_CONFIG__TIMEOUT_MACROP_B_HI,0x006E);
+			vl53l1x_write_reg_word(bus, RANGE_CONFIG__TIMEOUT_MACROP_A_HI,0x0060);
+			vl53l1x_write_reg_word(bus, RANGE_CONFIG__TIMEOUT_MACROP_B_HI,0x006E);
 			break;
 		case 50:
-			vl53l1x_write_reg_word(RANGE_CONFIG__TIMEOUT_MACROP_A_HI,0x00AD);
-			vl53l1x_write_reg_word(RANGE_CONFIG__TIMEOUT_MACROP_B_HI,0x00C6);
+			vl53l1x_write_reg_word(bus, RANGE_CONFIG__TIMEOUT_MACROP_A_HI,0x00AD);
+			vl53l1x_write_reg_word(bus, RANGE_CONFIG__TIMEOUT_MACROP_B_HI,0x00C6);
 			break;
 		case 100:
-			vl53l1x_write_reg_word(RANGE_CONFIG__TIMEOUT_MACROP_A_HI,0x01CC);
-			vl53l1x_write_reg_word(RANGE_CONFIG__TIMEOUT_MACROP_B_HI,0x01EA);
+			vl53l1x_write_reg_word(bus, RANGE_CONFIG__TIMEOUT_MACROP_A_HI,0x01CC);
+			vl53l1x_write_reg_word(bus, RANGE_CONFIG__TIMEOUT_MACROP_B_HI,0x01EA);
 			break;
 		case 200:
-			vl53l1x_write_reg_word(RANGE_CONFIG__TIMEOUT_MACROP_A_HI,0x02D9);
-			vl53l1x_write_reg_word(RANGE_CONFIG__TIMEOUT_MACROP_B_HI,0x02F8);
+			vl53l1x_write_reg_word(bus, RANGE_CONFIG__TIMEOUT_MACROP_A_HI,0x02D9);
+			vl53l1x_write_reg_word(bus, RANGE_CONFIG__TIMEOUT_MACROP_B_HI,0x02F8);
 			break;
 		case 500:
-			vl53l1x_write_reg_word(RANGE_CONFIG__TIMEOUT_MACROP_A_HI,0x048F);
-			vl53l1x_write_reg_word(RANGE_CONFIG__TIMEOUT_MACROP_B_HI,0x04A4);
+			vl53l1x_write_reg_word(bus, RANGE_CONFIG__TIMEOUT_MACROP_A_HI,0x048F);
+			vl53l1x_write_reg_word(bus, RANGE_CONFIG__TIMEOUT_MACROP_B_HI,0x04A4);
 			break;
 		default:
 			fprintf(stderr, "invalid timing budget\n");
@@ -439,7 +521,7 @@ int vl53l1x_init(float fov_deg, int TimingBudgetInMs)
 	}
 
 	// set optical center to the middle
-	vl53l1x_write_reg_byte(ROI_CONFIG__USER_ROI_CENTRE_SPAD, 199);
+	vl53l1x_write_reg_byte(bus, ROI_CONFIG__USER_ROI_CENTRE_SPAD, 199);
 
 	// pick correct SPAD size between 4x4 to 16x16 for desired fov
 	// also set the FOV that will actually be set in the enabled_sensors struct
@@ -479,15 +561,15 @@ int vl53l1x_init(float fov_deg, int TimingBudgetInMs)
 		printf("using %2d pads, for a diagonal fov of %6.1f deg\n", pads, (double)fov_deg);
 	}
 
-	vl53l1x_write_reg_byte(ROI_CONFIG__USER_ROI_REQUESTED_GLOBAL_XY_SIZE,  (pads-1)<<4 | (pads-1));
+	vl53l1x_write_reg_byte(bus, ROI_CONFIG__USER_ROI_REQUESTED_GLOBAL_XY_SIZE,  (pads-1)<<4 | (pads-1));
 
 
 	// stuff for automatic intermeasurement period, not used here
 	uint16_t ClockPLL;
 	uint16_t intermeasurement_time_ms = 30;
-	vl53l1x_read_reg_word(VL53L1_RESULT__OSC_CALIBRATE_VAL, &ClockPLL);
+	vl53l1x_read_reg_word(bus, VL53L1_RESULT__OSC_CALIBRATE_VAL, &ClockPLL);
 	ClockPLL = ClockPLL & 0x3FF;
-	vl53l1x_write_reg_int(VL53L1_SYSTEM__INTERMEASUREMENT_PERIOD,
+	vl53l1x_write_reg_int(bus, VL53L1_SYSTEM__INTERMEASUREMENT_PERIOD,
 				   (uint32_t)(ClockPLL * intermeasurement_time_ms * 1.075));
 
 	if(en_debug){
@@ -498,11 +580,11 @@ int vl53l1x_init(float fov_deg, int TimingBudgetInMs)
 }
 
 
-int vl53l1x_wait_for_data(void)
+int vl53l1x_wait_for_data(int bus)
 {
 	for(int i=0; i<20; i++){
 		uint8_t isDataReady = 0;
-		if(vl53l1x_check_for_data_ready(&isDataReady)){
+		if(vl53l1x_check_for_data_ready(bus, &isDataReady)){
 			fprintf(stderr, "failed to check data ready\n");
 			return -1;
 		}
@@ -517,7 +599,7 @@ int vl53l1x_wait_for_data(void)
 
 
 // this assumes mux is off and we can only see one sensor
-int vl53l1x_set_bus_to_default_slave_address(void)
+int vl53l1x_set_bus_to_default_slave_address(int bus)
 {
 	// check whoami at default address first
 	if(voxl_i2c_set_device_address(bus, VL53L1X_TOF_DEFAULT_ADDR)){
@@ -531,7 +613,7 @@ int vl53l1x_set_bus_to_default_slave_address(void)
 
 
 // this assumes mux is off and we can only see one sensor
-int vl53l1x_swap_to_secondary_address(void)
+int vl53l1x_swap_to_secondary_address(int bus)
 {
 	// check whoami at default address first
 	if(voxl_i2c_set_device_address(bus, VL53L1X_TOF_DEFAULT_ADDR)){
@@ -541,14 +623,14 @@ int vl53l1x_swap_to_secondary_address(void)
 	}
 
 
-	if(vl53l1x_check_whoami(1)==0){
+	if(vl53l1x_check_whoami(bus, 1)==0){
 		// device is at default address, put it to secondary
 		printf("swapping nonmux sensor to secondary address\n");
-		vl53l1x_set_address(VL53L1X_TOF_SECONDARY_ADDR);
+		vl53l1x_set_address(bus, VL53L1X_TOF_SECONDARY_ADDR);
 		usleep(1000);
 		// now check if it worked
 		voxl_i2c_set_device_address(bus, VL53L1X_TOF_SECONDARY_ADDR);
-		if(vl53l1x_check_whoami(1)==0){
+		if(vl53l1x_check_whoami(bus, 1)==0){
 			printf("successfully swapped to secondary\n");
 			return 0;
 		}
@@ -560,7 +642,7 @@ int vl53l1x_swap_to_secondary_address(void)
 	else{
 		printf("checking if secondary is set already\n");
 		voxl_i2c_set_device_address(bus, VL53L1X_TOF_SECONDARY_ADDR);
-		if(vl53l1x_check_whoami(1)==0){
+		if(vl53l1x_check_whoami(bus, 1)==0){
 			printf("device already on secondary\n");
 			return 0;
 		}
@@ -0,0 +1,70 @@
+/*******************************************************************************
+ * Copyright 2023 ModalAI Inc.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * 4. The Software is used solely in conjunction with devices provided by
+ *    ModalAI Inc.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR busINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ ******************************************************************************/
+
+
+
+#ifndef VL53L1X_H
+#define VL53L1X_H
+
+
+#include <voxl_io/i2c.h>
+#include <stdint.h>
+#include <voxl_rangefinder.h> // for rangefinder_result_t
+
+
+void vl53l1x_set_en_debug(int en);
+
+// every call takes the i2c bus to talk to, the driver keeps no bus state
+int vl53l1x_start_ranging(int bus);
+
+int vl53l1x_stop_ranging(int bus);
+
+int vl53l1x_clear_interrupt(int bus);
+
+int vl53l1x_check_for_data_ready(int bus, uint8_t *isDataReady);
+
+int vl53l1x_get_distance_mm(int bus, int* dist_mm, int* sd_mm);
+
+// same as vl53l1x_get_distance_mm but keeps the diagnostics from the same burst
+int vl53l1x_get_result(int bus, rangefinder_result_t* res);
+
+int vl53l1x_set_bus_to_default_slave_address(int bus);
+
+int vl53l1x_swap_to_secondary_address(int bus);
+
+
+int vl53l1x_check_whoami(int bus, int quiet);
+int vl53l1x_init(int bus, float fov_deg, int TimingBudgetInMs);
+int vl53l1x_wait_for_data(int bus);
+
+#endif // end #define VL53L1X_H
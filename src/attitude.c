@@ -0,0 +1,145 @@
+/*******************************************************************************
+ * Copyright 2023 ModalAI Inc.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * 4. The Software is used solely in conjunction with devices provided by
+ *    ModalAI Inc.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ ******************************************************************************/
+
+
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+
+#include "attitude.h"
+
+
+typedef struct attitude_entry_t{
+	int64_t t_ns;
+	float roll;
+	float pitch;
+	float yaw;
+} attitude_entry_t;
+
+
+static attitude_entry_t buf[ATTITUDE_BUF_LEN];
+static int n_entries = 0;
+static int newest = -1;
+static uint32_t seq = 0;
+
+
+void attitude_add(int64_t t_ns, float roll, float pitch, float yaw)
+{
+	// ignore out of order messages, interpolation needs them sorted
+	if(newest>=0 && t_ns <= buf[newest].t_ns) return;
+
+	int i = (newest+1) % ATTITUDE_BUF_LEN;
+
+	__atomic_store_n(&seq, seq+1, __ATOMIC_RELAXED);
+	__atomic_thread_fence(__ATOMIC_RELEASE);
+	buf[i].t_ns		= t_ns;
+	buf[i].roll		= roll;
+	buf[i].pitch	= pitch;
+	buf[i].yaw		= yaw;
+	newest = i;
+	if(n_entries<ATTITUDE_BUF_LEN) n_entries++;
+	__atomic_store_n(&seq, seq+1, __ATOMIC_RELEASE);
+	return;
+}
+
+
+void attitude_reset(void)
+{
+	__atomic_store_n(&seq, seq+1, __ATOMIC_RELAXED);
+	__atomic_thread_fence(__ATOMIC_RELEASE);
+	n_entries = 0;
+	newest = -1;
+	__atomic_store_n(&seq, seq+1, __ATOMIC_RELEASE);
+	return;
+}
+
+
+// wrap an angle difference into -pi to pi
+static float _wrap_pi(float a)
+{
+	while(a >  (float)M_PI) a -= 2.0f*(float)M_PI;
+	while(a < -(float)M_PI) a += 2.0f*(float)M_PI;
+	return a;
+}
+
+
+static int _interpolate(attitude_entry_t* b, int n, int head, int64_t t_ns, \
+						int64_t max_age_ns, float* roll, float* pitch, float* yaw)
+{
+	if(n<1) return -1;
+
+	attitude_entry_t* after = &b[head];
+
+	// past the newest, hold it if it's fresh enough
+	if(t_ns >= after->t_ns){
+		if(t_ns - after->t_ns > max_age_ns) return -1;
+		*roll	= after->roll;
+		*pitch	= after->pitch;
+		*yaw	= after->yaw;
+		return 0;
+	}
+
+	// walk backwards to find the pair that brackets t_ns
+	for(int k=1; k<n; k++){
+		attitude_entry_t* before = &b[(head-k+ATTITUDE_BUF_LEN) % ATTITUDE_BUF_LEN];
+		if(before->t_ns <= t_ns){
+			float a = (float)(t_ns - before->t_ns) / (float)(after->t_ns - before->t_ns);
+			*roll	= before->roll  + a*(after->roll  - before->roll);
+			*pitch	= before->pitch + a*(after->pitch - before->pitch);
+			*yaw	= _wrap_pi(before->yaw + a*_wrap_pi(after->yaw - before->yaw));
+			return 0;
+		}
+		after = before;
+	}
+
+	// older than everything we have
+	return -1;
+}
+
+
+int attitude_get(int64_t t_ns, int64_t max_age_ns, float* roll, float* pitch, float* yaw)
+{
+	attitude_entry_t copy[ATTITUDE_BUF_LEN];
+
+	for(int i=0; i<100; i++){
+		uint32_t s1 = __atomic_load_n(&seq, __ATOMIC_ACQUIRE);
+		if(s1 & 1) continue;
+		int n = n_entries;
+		int head = newest;
+		memcpy(copy, buf, sizeof(buf));
+		__atomic_thread_fence(__ATOMIC_ACQUIRE);
+		uint32_t s2 = __atomic_load_n(&seq, __ATOMIC_RELAXED);
+		if(s1==s2) return _interpolate(copy, n, head, t_ns, max_age_ns, roll, pitch, yaw);
+	}
+	return -1;
+}
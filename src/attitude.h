@@ -0,0 +1,62 @@
+/*******************************************************************************
+ * Copyright 2023 ModalAI Inc.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * 4. The Software is used solely in conjunction with devices provided by
+ *    ModalAI Inc.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ ******************************************************************************/
+
+
+#ifndef ATTITUDE_H
+#define ATTITUDE_H
+
+#include <stdint.h>
+
+// number of recent ATTITUDE messages kept for interpolation
+#define ATTITUDE_BUF_LEN	32
+
+/**
+ * Lock-free cache of recent autopilot attitude. There is a single writer, the
+ * mavlink pipe callback, and readers never block it. Readers retry if the
+ * writer was mid-update, like a seqlock.
+ */
+
+// add an attitude in radians, timestamped in CLOCK_MONOTONIC ns
+void attitude_add(int64_t t_ns, float roll, float pitch, float yaw);
+
+// forget everything, call from the writer thread when timestamps jump
+// backwards, e.g. after an autopilot reboot, since attitude_add() drops
+// anything older than the newest entry
+void attitude_reset(void);
+
+// interpolate the attitude at t_ns. Holds the newest attitude for up to
+// max_age_ns past it. Returns -1 if there is no attitude close enough.
+int attitude_get(int64_t t_ns, int64_t max_age_ns, float* roll, float* pitch, float* yaw);
+
+
+#endif // end #define ATTITUDE_H
@@ -0,0 +1,286 @@
+/*******************************************************************************
+ * Copyright 2023 ModalAI Inc.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * 4. The Software is used solely in conjunction with devices provided by
+ *    ModalAI Inc.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ ******************************************************************************/
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <pthread.h>
+#include <modal_pipe_server.h>
+#include <voxl_rangefinder_interface.h>
+
+#include "client_rate.h"
+#include "common.h"
+
+
+#define MODE_LATEST		0
+#define MODE_AVERAGE	1
+
+
+typedef struct client_rate_t{
+	int connected;
+	char name[MODAL_PIPE_MAX_NAME_LEN];
+	int64_t period_ns;				///< 0 for full rate
+	int mode;						///< MODE_LATEST or MODE_AVERAGE
+	int64_t window_start_ns;
+	// running sums for the averaging mode
+	int n[MAX_SENSORS];
+	double dist_sum[MAX_SENSORS];
+	double unc_sum[MAX_SENSORS];
+	double time_sum[MAX_SENSORS];
+	// stats
+	uint64_t n_sent;
+	uint64_t n_overflow;
+} client_rate_t;
+
+
+static int ch = -1;
+static client_rate_t clients[MAX_PIPE_CLIENTS];
+static pthread_mutex_t mtx = PTHREAD_MUTEX_INITIALIZER;
+
+
+static void _reset_window(client_rate_t* c, int64_t t)
+{
+	c->window_start_ns = t;
+	memset(c->n, 0, sizeof(c->n));
+	memset(c->dist_sum, 0, sizeof(c->dist_sum));
+	memset(c->unc_sum, 0, sizeof(c->unc_sum));
+	memset(c->time_sum, 0, sizeof(c->time_sum));
+}
+
+
+// parse "{rate_hz}[avg]" into a period and mode, returns -1 on bad string
+static int _parse_rate(const char* str, int64_t* period_ns, int* mode)
+{
+	char* end;
+	double hz = strtod(str, &end);
+	// nan and inf would make the period cast below undefined
+	if(end==str || !isfinite(hz) || hz<0.0) return -1;
+	// anything slower than this overflows the period
+	if(hz>0.0 && hz<CLIENT_RATE_MIN_HZ) return -1;
+
+	*mode = MODE_LATEST;
+	if(strncmp(end, "avg", 3)==0){
+		*mode = MODE_AVERAGE;
+		end += 3;
+	}
+	if(*end!=0 && *end!=' ' && *end!='\n') return -1;
+
+	if(hz==0.0) *period_ns = 0;
+	else *period_ns = (int64_t)(1000000000.0/hz);
+	return 0;
+}
+
+
+static void _set_rate(client_rate_t* c, int64_t period_ns, int mode)
+{
+	c->period_ns = period_ns;
+	c->mode = mode;
+	_reset_window(c, 0);
+	if(period_ns>0){
+		printf("client %s set to %.2fhz %s\n", c->name, 1000000000.0/period_ns,\
+							mode==MODE_AVERAGE ? "averaged" : "latest");
+	}
+	else printf("client %s set to full rate\n", c->name);
+}
+
+
+static void _connect_cb(__attribute__((unused)) int ch, int client_id, char* name, \
+									__attribute__((unused)) void* context)
+{
+	if(client_id<0 || client_id>=MAX_PIPE_CLIENTS) return;
+
+	pthread_mutex_lock(&mtx);
+	client_rate_t* c = &clients[client_id];
+	memset(c, 0, sizeof(client_rate_t));
+	c->connected = 1;
+	strncpy(c->name, name, sizeof(c->name)-1);
+
+	// check for a rate suffix in the client name
+	char* at = strrchr(name, '@');
+	int64_t period_ns;
+	int mode;
+	if(at!=NULL){
+		if(_parse_rate(at+1, &period_ns, &mode)==0) _set_rate(c, period_ns, mode);
+		else fprintf(stderr, "WARNING invalid rate suffix in client name %s, sending at full rate\n", name);
+	}
+	pthread_mutex_unlock(&mtx);
+	return;
+}
+
+
+static void _disconnect_cb(__attribute__((unused)) int ch, int client_id, \
+			__attribute__((unused)) char* name, __attribute__((unused)) void* context)
+{
+	if(client_id<0 || client_id>=MAX_PIPE_CLIENTS) return;
+
+	pthread_mutex_lock(&mtx);
+	client_rate_t* c = &clients[client_id];
+	if(c->connected && c->n_overflow>0){
+		printf("client %s disconnected after %llu packets with %llu overflows\n", \
+				c->name, (unsigned long long)c->n_sent, (unsigned long long)c->n_overflow);
+	}
+	c->connected = 0;
+	pthread_mutex_unlock(&mtx);
+	return;
+}
+
+
+int client_rate_init(int channel)
+{
+	ch = channel;
+	memset(clients, 0, sizeof(clients));
+	pipe_server_set_connect_cb(ch, _connect_cb, NULL);
+	pipe_server_set_disconnect_cb(ch, _disconnect_cb, NULL);
+	return 0;
+}
+
+
+int client_rate_handle_control(char* cmd)
+{
+	char name[MODAL_PIPE_MAX_NAME_LEN];
+	char rate[32];
+
+	if(strncmp(cmd, "set_rate", 8)) return 1;
+	if(sscanf(cmd, "set_rate %31s %31s", name, rate)!=2){
+		fprintf(stderr, "ERROR invalid set_rate command: %s\n", cmd);
+		return -1;
+	}
+
+	int64_t period_ns;
+	int mode;
+	if(_parse_rate(rate, &period_ns, &mode)){
+		fprintf(stderr, "ERROR invalid rate in set_rate command: %s\n", rate);
+		return -1;
+	}
+
+	pthread_mutex_lock(&mtx);
+	int found = 0;
+	for(int i=0; i<MAX_PIPE_CLIENTS; i++){
+		if(clients[i].connected && strcmp(clients[i].name, name)==0){
+			_set_rate(&clients[i], period_ns, mode);
+			found = 1;
+		}
+	}
+	pthread_mutex_unlock(&mtx);
+
+	if(!found){
+		fprintf(stderr, "ERROR set_rate: no client named %s\n", name);
+		return -1;
+	}
+	return 0;
+}
+
+
+static void _write(int id, client_rate_t* c, rangefinder_data_t* d, int n)
+{
+	if(pipe_server_write_to_client(ch, id, d, sizeof(rangefinder_data_t)*n)<0){
+		c->n_overflow++;
+		// don't flood the console, report on 1, 10, 100...
+		uint64_t k = c->n_overflow;
+		while(k>=10 && k%10==0) k/=10;
+		if(k==1){
+			fprintf(stderr, "WARNING client %s has overflowed %llu times\n", \
+									c->name, (unsigned long long)c->n_overflow);
+		}
+	}
+	else c->n_sent++;
+}
+
+
+static void _accumulate(client_rate_t* c, rangefinder_data_t* d, int n)
+{
+	for(int i=0; i<n; i++){
+		if(d[i].distance_m<0.0f) continue;
+		c->n[i]++;
+		c->dist_sum[i] += (double)d[i].distance_m;
+		c->unc_sum[i]  += (double)d[i].uncertainty_m;
+		c->time_sum[i] += (double)d[i].timestamp_ns;
+	}
+}
+
+
+int client_rate_publish(rangefinder_data_t* d, int n)
+{
+	// always write client by client, even at full rate, so every client gets
+	// its own overflow count
+	int64_t t = d[0].timestamp_ns;
+
+	pthread_mutex_lock(&mtx);
+	for(int id=0; id<MAX_PIPE_CLIENTS; id++){
+
+		client_rate_t* c = &clients[id];
+		if(!c->connected) continue;
+
+		if(c->period_ns==0){
+			_write(id, c, d, n);
+			continue;
+		}
+
+		// first sample, start the window now
+		if(c->window_start_ns==0){
+			c->window_start_ns = t;
+		}
+		else if((t - c->window_start_ns) >= c->period_ns){
+			if(c->mode==MODE_LATEST){
+				_write(id, c, d, n);
+			}
+			else{
+				rangefinder_data_t avg[MAX_SENSORS];
+				for(int i=0; i<n; i++){
+					avg[i] = d[i];
+					if(c->n[i]>0){
+						avg[i].distance_m    = c->dist_sum[i]/c->n[i];
+						// averaging n independent readings shrinks the uncertainty
+						avg[i].uncertainty_m = c->unc_sum[i]/c->n[i]/sqrt(c->n[i]);
+						avg[i].timestamp_ns  = c->time_sum[i]/c->n[i];
+					}
+					else avg[i].distance_m = -1;
+				}
+				_write(id, c, avg, n);
+			}
+
+			// step the window forward but don't let it fall behind if we stalled
+			int64_t next = c->window_start_ns + c->period_ns;
+			if(t-next > c->period_ns) next = t;
+			_reset_window(c, next);
+		}
+
+		// the current sample belongs to the new window
+		if(c->mode==MODE_AVERAGE) _accumulate(c, d, n);
+	}
+	pthread_mutex_unlock(&mtx);
+
+	return 0;
+}
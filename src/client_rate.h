@@ -0,0 +1,66 @@
+/*******************************************************************************
+ * Copyright 2023 ModalAI Inc.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * 4. The Software is used solely in conjunction with devices provided by
+ *    ModalAI Inc.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ ******************************************************************************/
+
+#ifndef CLIENT_RATE_H
+#define CLIENT_RATE_H
+
+#include <voxl_rangefinder_interface.h>
+
+/**
+ * Per-client rate decimation for the main rangefinders pipe.
+ *
+ * A client can request a lower rate by appending @{rate_hz} to its client
+ * name, e.g. "voxl-logger@5". Add "avg" after the rate, e.g. "voxl-logger@5avg",
+ * to receive the average of each window instead of the latest sample.
+ * The same can be set or changed at runtime with the control command:
+ *   set_rate {client_name} {rate_hz}[avg]
+ * where a rate of 0 goes back to full rate.
+ */
+
+#define CLIENT_RATE_CONTROL_COMMANDS "set_rate"
+
+// lowest non-zero rate a client can ask for
+#define CLIENT_RATE_MIN_HZ	0.001
+
+// set up connect/disconnect callbacks on the given server channel
+int client_rate_init(int ch);
+
+// returns 0 if the command was handled, 1 if it's not a set_rate command,
+// or -1 if it was but couldn't be handled
+int client_rate_handle_control(char* cmd);
+
+// write to all clients, each at their requested rate
+int client_rate_publish(rangefinder_data_t* d, int n);
+
+
+#endif // end #define CLIENT_RATE_H
@@ -34,10 +34,16 @@
 #ifndef COMMON_H
 #define COMMON_H
 
+#include <stdint.h>
+#include <time.h>
+
 #define PROCESS_NAME	"voxl-rangefinder-server"
 
 #define MAX_SENSORS	32
 
+// matches the per-channel client limit in libmodal_pipe
+#define MAX_PIPE_CLIENTS	16
+
 #define TCA9548A_MUX_DEFAULT_ADDR	0x70
 
 #define M0195_MUX_DEFAULT_ADDR  0x73
@@ -52,6 +58,22 @@
 
 // client pipe channels
 #define MAV_PIPE_CH 0
+#define IMU_PIPE_CH 1
+#define POSE_PIPE_CH 2
+
+// hold the newest autopilot attitude at most this long past its timestamp
+#define ATTITUDE_MAX_AGE_NS	100000000
+
+// hold the newest VIO pose at most this long past its timestamp
+#define POSE_MAX_AGE_NS		200000000
+
+
+static inline int64_t time_monotonic_ns(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (int64_t)ts.tv_sec*1000000000 + (int64_t)ts.tv_nsec;
+}
 
 
 #endif // end #define COMMON_H
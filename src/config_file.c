@@ -49,18 +49,54 @@
 // everything else is just concerned with the enabled_sensors array
 int n_total_sensors;
 rangefinder_config_t r[MAX_SENSORS];
+filter_config_t r_filter[MAX_SENSORS];
 int vl53l1x_timing_budget_ms;
 
 
 // all enabled sensors and some easy-access data about them
 int n_enabled_sensors;
 rangefinder_config_t enabled_sensors[MAX_SENSORS];
+filter_config_t enabled_filters[MAX_SENSORS];
 
-int has_nonmux_sensor = 0;
-int n_mux_sensors = 0;
-int mux_address = 0;
 int bus;
 int id_for_mavlink = -1;
+int n_mavlink_sensor_ids = 0;
+int mavlink_sensor_ids[MAX_SENSORS];
+int en_extended_output = 0;
+int en_per_sensor_pipes = 0;
+float history_s = 0.0f;
+int en_shm_latest = 0;
+int en_point_cloud = 0;
+int en_point_cloud_cone_edges = 0;
+int en_mavlink_obstacle_distance = 0;
+char mavlink_uart[64] = "";
+int mavlink_uart_baud = 921600;
+int en_height = 0;
+float height_max_tilt_deg = 30.0f;
+int en_height_predictor = 0;
+char predictor_imu_pipe[64] = "imu_apps";
+float predictor_rate_hz = 200.0f;
+float predictor_accel_noise = 0.5f;
+float predictor_imu_rpy_deg[3] = {0.0f, 0.0f, 0.0f};
+int en_range_rate = 0;
+float range_rate_alpha = 0.5f;
+float range_rate_beta = 0.15f;
+int en_range_rate_latency_comp = 0;
+int en_pipeline_thread = 0;
+float oversample_hz = 0.0f;
+int en_consistency_check = 0;
+float consistency_sigma = 3.0f;
+float consistency_max_incidence_deg = 30.0f;
+int consistency_reject = 0;
+float frame_rate_hz = 0.0f;
+int frame_max_age_ms = 500;
+char pose_pipe[64] = "vvhub_body_wrt_local";
+int en_voxel_map = 0;
+float voxel_size_m = 0.1f;
+int voxel_map_cells = 16384;
+float voxel_decay_s = 10.0f;
+int voxel_max_ray_cells = 64;
+int en_world_points = 0;
 
 
 #define CONFIG_FILE_HEADER "\
@@ -78,9 +114,105 @@ int id_for_mavlink = -1;
  * vl53l1x FOV options are 15, 20, and 27 degrees\n\
  * default is 27\n\
  *\n\
- * set id_for_mavlink to a valid id (0+) to publish that sensor reading to\n\
- * mavlink as a DOWNWARD sensor for the autopilot to use\n\
+ * set id_for_mavlink to a valid sensor_id (0+) to publish that sensor reading\n\
+ * to mavlink as a DISTANCE_SENSOR for the autopilot to use\n\
  * set to -1 to disable this feature.\n\
+ *\n\
+ * mavlink_sensor_ids: list of sensor_ids to publish as DISTANCE_SENSOR, each\n\
+ * with its own id and an orientation taken from direction_wrt_body. When\n\
+ * this list is empty id_for_mavlink is used instead.\n\
+ *\n\
+ * mavlink_uart: optional serial device such as /dev/ttyHS1 to write\n\
+ * DISTANCE_SENSOR to directly instead of through voxl-mavlink-server for\n\
+ * the lowest latency. Leave empty to disable. mavlink_uart_baud sets the\n\
+ * baud rate. Other messages still go through voxl-mavlink-server.\n\
+ *\n\
+ * en_height: publish tilt-compensated height above ground from every\n\
+ * downward sensor on the rangefinder_height pipe using autopilot ATTITUDE.\n\
+ * Readings taken while the sensor ray is more than height_max_tilt_deg\n\
+ * from vertical are rejected.\n\
+ *\n\
+ * en_height_predictor: propagate height and vertical velocity between\n\
+ * rangefinder samples with the IMU on predictor_imu_pipe and publish it at\n\
+ * predictor_rate_hz on rangefinder_height_predicted. IMU samples are rotated\n\
+ * into body FRD frame with the body to predictor_imu_pipe entry in\n\
+ * /etc/modalai/extrinsics.conf, or with predictor_imu_rpy_deg if there is no\n\
+ * such entry. predictor_imu_rpy_deg uses the same convention as\n\
+ * RPY_parent_to_child in extrinsics.conf: intrinsic XYZ roll pitch yaw in\n\
+ * degrees from body to IMU. predictor_accel_noise is the accelerometer noise\n\
+ * in m/s^2.\n\
+ *\n\
+ * en_range_rate: publish a filtered range rate and time to contact for\n\
+ * every sensor on rangefinder_range_rate. range_rate_alpha and\n\
+ * range_rate_beta are the alpha-beta filter gains, lower is smoother. alpha\n\
+ * must be in (0,1] and beta in (0,4-2*alpha) for the filter to be stable.\n\
+ * en_range_rate_latency_comp extrapolates distance_now_m to the time of\n\
+ * publishing to remove the sampling and processing delay.\n\
+ *\n\
+ * oversample_hz: set above 0 to run the sensors at the rate set by\n\
+ * vl53l1x_timing_budget_ms but only publish at this rate. Each published\n\
+ * reading is the sigma-weighted average of the valid readings in that\n\
+ * window, e.g. a 20ms budget with 10hz output averages about 5 readings.\n\
+ *\n\
+ * en_consistency_check: compare sensors with overlapping fields of view\n\
+ * every sample. Both readings are projected onto the direction halfway\n\
+ * between the two sensors. Their depths are allowed to differ by\n\
+ * consistency_sigma combined standard deviations, plus what a surface\n\
+ * tilted up to consistency_max_incidence_deg away from facing the sensors\n\
+ * would explain. Past that both readings get their uncertainty grown to\n\
+ * cover the difference. consistency_reject drops them instead, leave it off\n\
+ * unless the sensors mostly see surfaces facing them since it also drops\n\
+ * good readings of steeper surfaces and object edges.\n\
+ *\n\
+ * frame_rate_hz: set above 0 to publish the latest reading from every\n\
+ * sensor in one rangefinder_frame_t at this rate on rangefinder_frames.\n\
+ * Readings older than frame_max_age_ms are left out of the valid mask.\n\
+ *\n\
+ * en_voxel_map: keep a local occupancy map around the vehicle in shared\n\
+ * memory, see voxl_rangefinder_voxel.h. Each reading is ray-cast into\n\
+ * voxel_size_m cells using the pose from pose_pipe at the sample time,\n\
+ * touching at most voxel_max_ray_cells cells per ray. The map holds voxel_map_cells cells\n\
+ * (rounded up to a power of 2) and forgets cells with time constant\n\
+ * voxel_decay_s seconds.\n\
+ *\n\
+ * en_world_points: publish each valid reading as a hit point with\n\
+ * covariance in the local frame on rangefinder_world_points, using the\n\
+ * pose from pose_pipe interpolated to the sample time.\n\
+ *\n\
+ * en_pipeline_thread: run filtering, mavlink, and pipe output on a worker\n\
+ * thread so the sampling thread only talks to the sensors. Per-stage cost\n\
+ * is printed with --timing either way.\n\
+ *\n\
+ * Each sensor can set filter to none, median, hampel, or kalman. Filtered\n\
+ * readings go out on rangefinder_filtered, the raw pipes are unchanged.\n\
+ * median and hampel use the last filter_window readings (3-9). hampel\n\
+ * replaces readings more than filter_hampel_k robust standard deviations\n\
+ * from the median. kalman uses each reading's sigma with a random walk of\n\
+ * filter_process_noise in m/sqrt(s), the standard deviation the distance is\n\
+ * expected to wander by over one second, and drops readings outside its\n\
+ * 3 sigma gate.\n\
+ *\n\
+ * en_mavlink_obstacle_distance: send every sensor whose fov crosses the\n\
+ * horizontal plane to the autopilot as one 72-sector OBSTACLE_DISTANCE\n\
+ * message per sample for PX4 collision prevention.\n\
+ *\n\
+ * en_extended_output: publish the rangefinder_samples_extended pipe which\n\
+ * includes range status, signal rate, ambient rate and SPAD count\n\
+ *\n\
+ * en_per_sensor_pipes: also publish each sensor on its own pipe named\n\
+ * rangefinder_{sensor_id} for clients that only need one sensor\n\
+ *\n\
+ * history_s: number of seconds of samples to keep so clients can request\n\
+ * a backfill with the send_history control command. 0 to disable. When\n\
+ * enabled the sensors keep sampling even when no clients are connected.\n\
+ *\n\
+ * en_shm_latest: publish the latest sample of each sensor in shared memory\n\
+ * for lock-free polling, see voxl_rangefinder_shm.h. Sensors keep sampling\n\
+ * when this is enabled since shared memory readers can't be counted.\n\
+ *\n\
+ * en_point_cloud: publish valid readings as a body-frame point cloud on the\n\
+ * rangefinder_point_cloud pipe using each sensor's location and direction.\n\
+ * en_point_cloud_cone_edges adds 4 points per reading outlining the fov cone.\n\
  */\n"
 
 
@@ -113,14 +245,52 @@ void print_config(void)
 {
 	int i,j;
 	const char* type_strings[] = RANGEFINDER_TYPE_STRINGS;
+	const char* filter_strings[] = FILTER_TYPE_STRINGS;
 
 	printf("=================================================\n");
 	printf("i2c_bus: %d\n", bus);
-	printf("has_nonmux_sensor: %d\n", has_nonmux_sensor);
-	printf("n_mux_sensors:     %d\n", n_mux_sensors);
 	printf("n_enabled_sensors: %d\n", n_enabled_sensors);
 	printf("vl53l1x_timing_budget_ms: %d\n", vl53l1x_timing_budget_ms);
 	printf("id_for_mavlink:    %d\n", id_for_mavlink);
+	printf("mavlink_sensor_ids:");
+	for(i=0; i<n_mavlink_sensor_ids; i++) printf(" %d", mavlink_sensor_ids[i]);
+	printf("\n");
+	printf("en_extended_output: %d\n", en_extended_output);
+	printf("en_per_sensor_pipes: %d\n", en_per_sensor_pipes);
+	printf("history_s:         %0.1f\n", (double)history_s);
+	printf("en_shm_latest:     %d\n", en_shm_latest);
+	printf("en_point_cloud:    %d\n", en_point_cloud);
+	printf("en_point_cloud_cone_edges: %d\n", en_point_cloud_cone_edges);
+	printf("en_mavlink_obstacle_distance: %d\n", en_mavlink_obstacle_distance);
+	printf("mavlink_uart:      %s\n", mavlink_uart);
+	printf("mavlink_uart_baud: %d\n", mavlink_uart_baud);
+	printf("en_height:         %d\n", en_height);
+	printf("height_max_tilt_deg: %0.1f\n", (double)height_max_tilt_deg);
+	printf("en_height_predictor: %d\n", en_height_predictor);
+	printf("predictor_imu_pipe: %s\n", predictor_imu_pipe);
+	printf("predictor_rate_hz: %0.1f\n", (double)predictor_rate_hz);
+	printf("predictor_accel_noise: %0.2f\n", (double)predictor_accel_noise);
+	printf("predictor_imu_rpy_deg: %0.1f %0.1f %0.1f\n", (double)predictor_imu_rpy_deg[0], \
+						(double)predictor_imu_rpy_deg[1], (double)predictor_imu_rpy_deg[2]);
+	printf("en_range_rate:     %d\n", en_range_rate);
+	printf("range_rate_alpha:  %0.2f\n", (double)range_rate_alpha);
+	printf("range_rate_beta:   %0.2f\n", (double)range_rate_beta);
+	printf("en_range_rate_latency_comp: %d\n", en_range_rate_latency_comp);
+	printf("en_pipeline_thread: %d\n", en_pipeline_thread);
+	printf("oversample_hz:     %0.1f\n", (double)oversample_hz);
+	printf("en_consistency_check: %d\n", en_consistency_check);
+	printf("consistency_sigma: %0.1f\n", (double)consistency_sigma);
+	printf("consistency_max_incidence_deg: %0.1f\n", (double)consistency_max_incidence_deg);
+	printf("consistency_reject: %d\n", consistency_reject);
+	printf("frame_rate_hz:     %0.1f\n", (double)frame_rate_hz);
+	printf("frame_max_age_ms:  %d\n", frame_max_age_ms);
+	printf("pose_pipe:         %s\n", pose_pipe);
+	printf("en_voxel_map:      %d\n", en_voxel_map);
+	printf("voxel_size_m:      %0.3f\n", (double)voxel_size_m);
+	printf("voxel_map_cells:   %d\n", voxel_map_cells);
+	printf("voxel_decay_s:     %0.1f\n", (double)voxel_decay_s);
+	printf("voxel_max_ray_cells: %d\n", voxel_max_ray_cells);
+	printf("en_world_points:   %d\n", en_world_points);
 
 	for(i=0; i<n_total_sensors; i++){
 		printf("#%d:\n",i);
@@ -142,6 +312,17 @@ void print_config(void)
 		printf("    i2c_mux_address:       0x%X\n", r[i].i2c_mux_address);
 		printf("    i2c_mux_port:          %d\n", r[i].i2c_mux_port);
 
+		printf("    filter:                %s\n", filter_strings[r_filter[i].type]);
+		if(r_filter[i].type==FILTER_MEDIAN || r_filter[i].type==FILTER_HAMPEL){
+			printf("    filter_window:         %d\n", r_filter[i].window);
+		}
+		if(r_filter[i].type==FILTER_HAMPEL){
+			printf("    filter_hampel_k:       %0.2f\n", (double)r_filter[i].hampel_k);
+		}
+		if(r_filter[i].type==FILTER_KALMAN){
+			printf("    filter_process_noise:  %0.3f\n", (double)r_filter[i].process_noise);
+		}
+
 		printf("\n");
 	}
 
@@ -156,6 +337,7 @@ int read_config_file()
 	// vars and defaults
 	int i;
 	const char* type_strings[] = RANGEFINDER_TYPE_STRINGS;
+	const char* filter_strings[] = FILTER_TYPE_STRINGS;
 	rangefinder_config_t default_r = _get_default_config();
 
 	// set number of sensors to 0 at first in case there is an error
@@ -193,6 +375,59 @@ int read_config_file()
 	json_fetch_int_with_default(parent, "vl53l1x_timing_budget_ms", &vl53l1x_timing_budget_ms, DEFUALT_VL53L1X_TIMING_BUDGET_MS);
 	json_fetch_int_with_default(parent, "id_for_mavlink", &id_for_mavlink, id_for_mavlink);
 
+	int n_ids;
+	cJSON* json_ids = json_fetch_array_and_add_if_missing(parent, "mavlink_sensor_ids", &n_ids);
+	n_mavlink_sensor_ids = 0;
+	for(i=0; i<n_ids && i<MAX_SENSORS; i++){
+		cJSON* json_id = cJSON_GetArrayItem(json_ids, i);
+		if(!cJSON_IsNumber(json_id)){
+			fprintf(stderr, "ERROR reading config file, mavlink_sensor_ids must be numbers\n");
+			return -1;
+		}
+		mavlink_sensor_ids[n_mavlink_sensor_ids++] = json_id->valueint;
+	}
+	// fall back to the single legacy sensor
+	if(n_mavlink_sensor_ids==0 && id_for_mavlink>=0){
+		mavlink_sensor_ids[n_mavlink_sensor_ids++] = id_for_mavlink;
+	}
+
+	json_fetch_bool_with_default(parent, "en_extended_output", &en_extended_output, 0);
+	json_fetch_bool_with_default(parent, "en_per_sensor_pipes", &en_per_sensor_pipes, 0);
+	json_fetch_float_with_default(parent, "history_s", &history_s, 0.0f);
+	json_fetch_bool_with_default(parent, "en_shm_latest", &en_shm_latest, 0);
+	json_fetch_bool_with_default(parent, "en_point_cloud", &en_point_cloud, 0);
+	json_fetch_bool_with_default(parent, "en_point_cloud_cone_edges", &en_point_cloud_cone_edges, 0);
+	json_fetch_bool_with_default(parent, "en_mavlink_obstacle_distance", &en_mavlink_obstacle_distance, 0);
+	json_fetch_string_with_default(parent, "mavlink_uart", mavlink_uart, sizeof(mavlink_uart), "");
+	json_fetch_int_with_default(parent, "mavlink_uart_baud", &mavlink_uart_baud, 921600);
+	json_fetch_bool_with_default(parent, "en_height", &en_height, 0);
+	json_fetch_float_with_default(parent, "height_max_tilt_deg", &height_max_tilt_deg, 30.0f);
+	json_fetch_bool_with_default(parent, "en_height_predictor", &en_height_predictor, 0);
+	json_fetch_string_with_default(parent, "predictor_imu_pipe", predictor_imu_pipe, sizeof(predictor_imu_pipe), "imu_apps");
+	json_fetch_float_with_default(parent, "predictor_rate_hz", &predictor_rate_hz, 200.0f);
+	json_fetch_float_with_default(parent, "predictor_accel_noise", &predictor_accel_noise, 0.5f);
+	float default_imu_rpy_deg[3] = {0.0f, 0.0f, 0.0f};
+	json_fetch_fixed_vector_float_with_default(parent, "predictor_imu_rpy_deg", predictor_imu_rpy_deg, 3, default_imu_rpy_deg);
+	json_fetch_bool_with_default(parent, "en_range_rate", &en_range_rate, 0);
+	json_fetch_float_with_default(parent, "range_rate_alpha", &range_rate_alpha, 0.5f);
+	json_fetch_float_with_default(parent, "range_rate_beta", &range_rate_beta, 0.15f);
+	json_fetch_bool_with_default(parent, "en_range_rate_latency_comp", &en_range_rate_latency_comp, 0);
+	json_fetch_bool_with_default(parent, "en_pipeline_thread", &en_pipeline_thread, 0);
+	json_fetch_float_with_default(parent, "oversample_hz", &oversample_hz, 0.0f);
+	json_fetch_bool_with_default(parent, "en_consistency_check", &en_consistency_check, 0);
+	json_fetch_float_with_default(parent, "consistency_sigma", &consistency_sigma, 3.0f);
+	json_fetch_float_with_default(parent, "consistency_max_incidence_deg", &consistency_max_incidence_deg, 30.0f);
+	json_fetch_bool_with_default(parent, "consistency_reject", &consistency_reject, 0);
+	json_fetch_float_with_default(parent, "frame_rate_hz", &frame_rate_hz, 0.0f);
+	json_fetch_int_with_default(parent, "frame_max_age_ms", &frame_max_age_ms, 500);
+	json_fetch_string_with_default(parent, "pose_pipe", pose_pipe, sizeof(pose_pipe), "vvhub_body_wrt_local");
+	json_fetch_bool_with_default(parent, "en_voxel_map", &en_voxel_map, 0);
+	json_fetch_float_with_default(parent, "voxel_size_m", &voxel_size_m, 0.1f);
+	json_fetch_int_with_default(parent, "voxel_map_cells", &voxel_map_cells, 16384);
+	json_fetch_float_with_default(parent, "voxel_decay_s", &voxel_decay_s, 10.0f);
+	json_fetch_int_with_default(parent, "voxel_max_ray_cells", &voxel_max_ray_cells, 64);
+	json_fetch_bool_with_default(parent, "en_world_points", &en_world_points, 0);
+
 	// copy out each item in the array
 	for(i=0; i<n_total_sensors; i++){
 		cJSON* json_item = cJSON_GetArrayItem(json_array, i);
@@ -210,6 +445,11 @@ int read_config_file()
 		json_fetch_bool_with_default(json_item, "is_on_mux", &r[i].is_on_mux, default_r.is_on_mux);
 		json_fetch_int_with_default(json_item, "i2c_mux_address", &r[i].i2c_mux_address, default_r.i2c_mux_address);
 		json_fetch_int_with_default(json_item, "i2c_mux_port", &r[i].i2c_mux_port, default_r.i2c_mux_port);
+
+		json_fetch_enum_with_default(json_item, "filter", &r_filter[i].type, filter_strings, N_FILTER_TYPES, FILTER_NONE);
+		json_fetch_int_with_default(json_item, "filter_window", &r_filter[i].window, 5);
+		json_fetch_float_with_default(json_item, "filter_hampel_k", &r_filter[i].hampel_k, 3.0f);
+		json_fetch_float_with_default(json_item, "filter_process_noise", &r_filter[i].process_noise, 1.0f);
 	}
 
 	// check if we got any errors in that process
@@ -226,29 +466,40 @@ int read_config_file()
 	}
 	cJSON_Delete(parent);
 
+	if(oversample_hz<0.0f){
+		fprintf(stderr, "ERROR reading config file, oversample_hz must be >= 0\n");
+		return -1;
+	}
+	if(oversample_hz>0.0f && 1000.0f/oversample_hz < vl53l1x_timing_budget_ms){
+		fprintf(stderr, "WARNING oversample_hz is faster than the timing budget, nothing will be averaged\n");
+	}
+	// outside these the alpha-beta filter is unstable and diverges
+	if(!(range_rate_alpha>0.0f && range_rate_alpha<=1.0f)){
+		fprintf(stderr, "ERROR reading config file, range_rate_alpha must be in (0,1]\n");
+		return -1;
+	}
+	if(!(range_rate_beta>0.0f && range_rate_beta<4.0f-2.0f*range_rate_alpha)){
+		fprintf(stderr, "ERROR reading config file, range_rate_beta must be in (0,4-2*alpha)\n");
+		return -1;
+	}
+
 
 	// now go through the sensors to figure out the higher level information
+	// mux layout is worked out by rangefinder_ctx_init() in the library
 	for(i=0; i<n_total_sensors; i++){
 
 		// keep an array of just the enabled sensors to read from later
 		if(r[i].enabled){
 			n_enabled_sensors++;
 			enabled_sensors[n_enabled_sensors-1] = r[i];
+			enabled_filters[n_enabled_sensors-1] = r_filter[i];
 		}
 
-		// flag if we have an oddball sensor not on multiplexer
-		if(!r[i].is_on_mux && r[i].enabled){
-			has_nonmux_sensor = 1;
-		}
-
-		// make sure mux port is in 0-7
-		if(r[i].is_on_mux && r[i].enabled){
-			if(r[i].i2c_mux_port<0 || r[i].i2c_mux_port>7){
-				fprintf(stderr, "ERROR reading config file, i2c_mux_port must be in 0-7\n");
+		if(r[i].enabled && r_filter[i].type!=FILTER_NONE){
+			if(r_filter[i].window<3 || r_filter[i].window>FILTER_MAX_WINDOW){
+				fprintf(stderr, "ERROR reading config file, filter_window must be in 3-%d\n", FILTER_MAX_WINDOW);
 				return -1;
 			}
-			n_mux_sensors++;
-			mux_address = r[i].i2c_mux_address;
 		}
 	}
 
@@ -289,6 +540,11 @@ static int _add_rangefinder_config_to_json(rangefinder_config_t* r, int n, cJSON
 		cJSON_AddBoolToObject(json_item, "is_on_mux", r[i].is_on_mux);
 		cJSON_AddNumberToObject(json_item, "i2c_mux_address", r[i].i2c_mux_address);
 		cJSON_AddNumberToObject(json_item, "i2c_mux_port", r[i].i2c_mux_port);
+
+		cJSON_AddStringToObject(json_item, "filter", "none");
+		cJSON_AddNumberToObject(json_item, "filter_window", 5);
+		cJSON_AddNumberToObject(json_item, "filter_hampel_k", 3.0);
+		cJSON_AddNumberToObject(json_item, "filter_process_noise", 1.0);
 	}
 
 	return 0;
@@ -495,6 +751,43 @@ int write_new_config_file_with_defaults(int arrangement)
 	cJSON_AddNumberToObject(parent, "i2c_bus", bus);
 	cJSON_AddNumberToObject(parent, "vl53l1x_timing_budget_ms", DEFUALT_VL53L1X_TIMING_BUDGET_MS); // vl53l1x is stupid here, we should change to more general later to avoid confusion -Peter L
 	cJSON_AddNumberToObject(parent, "id_for_mavlink", id_for_mavlink);
+	cJSON_AddItemToObject(parent, "mavlink_sensor_ids", cJSON_CreateArray());
+	cJSON_AddBoolToObject(parent, "en_extended_output", 0);
+	cJSON_AddBoolToObject(parent, "en_per_sensor_pipes", 0);
+	cJSON_AddNumberToObject(parent, "history_s", 0);
+	cJSON_AddBoolToObject(parent, "en_shm_latest", 0);
+	cJSON_AddBoolToObject(parent, "en_point_cloud", 0);
+	cJSON_AddBoolToObject(parent, "en_point_cloud_cone_edges", 0);
+	cJSON_AddBoolToObject(parent, "en_mavlink_obstacle_distance", 0);
+	cJSON_AddStringToObject(parent, "mavlink_uart", "");
+	cJSON_AddNumberToObject(parent, "mavlink_uart_baud", 921600);
+	cJSON_AddBoolToObject(parent, "en_height", 0);
+	cJSON_AddNumberToObject(parent, "height_max_tilt_deg", 30.0);
+	cJSON_AddBoolToObject(parent, "en_height_predictor", 0);
+	cJSON_AddStringToObject(parent, "predictor_imu_pipe", "imu_apps");
+	cJSON_AddNumberToObject(parent, "predictor_rate_hz", 200.0);
+	cJSON_AddNumberToObject(parent, "predictor_accel_noise", 0.5);
+	float default_imu_rpy_deg[3] = {0.0f, 0.0f, 0.0f};
+	cJSON_AddItemToObject(parent, "predictor_imu_rpy_deg", cJSON_CreateFloatArray(default_imu_rpy_deg, 3));
+	cJSON_AddBoolToObject(parent, "en_range_rate", 0);
+	cJSON_AddNumberToObject(parent, "range_rate_alpha", 0.5);
+	cJSON_AddNumberToObject(parent, "range_rate_beta", 0.15);
+	cJSON_AddBoolToObject(parent, "en_range_rate_latency_comp", 0);
+	cJSON_AddBoolToObject(parent, "en_pipeline_thread", 0);
+	cJSON_AddNumberToObject(parent, "oversample_hz", 0.0);
+	cJSON_AddBoolToObject(parent, "en_consistency_check", 0);
+	cJSON_AddNumberToObject(parent, "consistency_sigma", 3.0);
+	cJSON_AddNumberToObject(parent, "consistency_max_incidence_deg", 30.0);
+	cJSON_AddBoolToObject(parent, "consistency_reject", 0);
+	cJSON_AddNumberToObject(parent, "frame_rate_hz", 0.0);
+	cJSON_AddNumberToObject(parent, "frame_max_age_ms", 500);
+	cJSON_AddStringToObject(parent, "pose_pipe", "vvhub_body_wrt_local");
+	cJSON_AddBoolToObject(parent, "en_voxel_map", 0);
+	cJSON_AddNumberToObject(parent, "voxel_size_m", 0.1);
+	cJSON_AddNumberToObject(parent, "voxel_map_cells", 16384);
+	cJSON_AddNumberToObject(parent, "voxel_decay_s", 10.0);
+	cJSON_AddNumberToObject(parent, "voxel_max_ray_cells", 64);
+	cJSON_AddBoolToObject(parent, "en_world_points", 0);
 
 	_add_rangefinder_config_to_json(r,n_sensors, parent);
 	json_write_to_file_with_header(CONFIG_FILE_PATH, parent, CONFIG_FILE_HEADER);
@@ -36,26 +36,25 @@
 
 
 #include "common.h"
+#include <voxl_rangefinder.h>
 
 
-// struct to contain all data from each single tag entry in config file
-typedef struct rangefinder_config_t{
+// per-sensor filter options, see filter.c
+#define FILTER_NONE			0
+#define FILTER_MEDIAN		1
+#define FILTER_HAMPEL		2
+#define FILTER_KALMAN		3
+#define N_FILTER_TYPES		4
+#define FILTER_TYPE_STRINGS {"none", "median", "hampel", "kalman"}
 
-	int enabled;					///< a sensor is allowed to be listed and configured but disabled
-	int sensor_id;					///< ID of the rangefinder, must be unique
-	int type;						///< see voxl_rangefinder_interface.h
+#define FILTER_MAX_WINDOW	9
 
-	float fov_deg;					///< field of view of the sensor in degrees
-	float range_max_m;				///< Maximum range of the sensor in meters
-
-	float location_wrt_body[3];		///< location of the rangefinder with respect to body frame.
-	float direction_wrt_body[3];	///< direction vector of the rangefinder with respect to body frame
-
-	int is_on_mux;					// set non-zero to indicate this is connected through an i2c multiplexer
-	int i2c_mux_address;			// multiplexer address
-	int i2c_mux_port;				// 1-8
-
-} rangefinder_config_t;
+typedef struct filter_config_t{
+	int type;						///< one of FILTER_*
+	int window;						///< samples in the median/hampel window, 3 to FILTER_MAX_WINDOW
+	float hampel_k;					///< hampel threshold in standard deviations
+	float process_noise;			///< kalman random walk in m/sqrt(s)
+} filter_config_t;
 
 
 
@@ -63,19 +62,55 @@ typedef struct rangefinder_config_t{
 // everything else is just concerned with the enabled_sensors array
 extern int n_total_sensors;
 extern rangefinder_config_t r[MAX_SENSORS];
+extern filter_config_t r_filter[MAX_SENSORS];
 extern int vl53l1x_timing_budget_ms;
 
 
 // all enabled sensors and some easy-access data about them
 extern int n_enabled_sensors;
 extern rangefinder_config_t enabled_sensors[MAX_SENSORS];
+extern filter_config_t enabled_filters[MAX_SENSORS];
 
-extern int has_nonmux_sensor; // should ideally be the first one!
-extern int n_mux_sensors;
-extern int mux_address;
 extern int bus;
 
 extern int id_for_mavlink;
+extern int n_mavlink_sensor_ids;
+extern int mavlink_sensor_ids[MAX_SENSORS];
+extern int en_extended_output;
+extern int en_per_sensor_pipes;
+extern float history_s;
+extern int en_shm_latest;
+extern int en_point_cloud;
+extern int en_point_cloud_cone_edges;
+extern int en_mavlink_obstacle_distance;
+extern char mavlink_uart[64];
+extern int mavlink_uart_baud;
+extern int en_height;
+extern float height_max_tilt_deg;
+extern int en_height_predictor;
+extern char predictor_imu_pipe[64];
+extern float predictor_rate_hz;
+extern float predictor_accel_noise;
+extern float predictor_imu_rpy_deg[3];
+extern int en_range_rate;
+extern float range_rate_alpha;
+extern float range_rate_beta;
+extern int en_range_rate_latency_comp;
+extern int en_pipeline_thread;
+extern float oversample_hz;
+extern int en_consistency_check;
+extern float consistency_sigma;
+extern float consistency_max_incidence_deg;
+extern int consistency_reject;
+extern float frame_rate_hz;
+extern int frame_max_age_ms;
+extern char pose_pipe[64];
+extern int en_voxel_map;
+extern float voxel_size_m;
+extern int voxel_map_cells;
+extern float voxel_decay_s;
+extern int voxel_max_ray_cells;
+extern int en_world_points;
 
 
 void print_config(void);
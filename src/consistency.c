@@ -0,0 +1,192 @@
+/*******************************************************************************
+ * Copyright 2023 ModalAI Inc.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * 4. The Software is used solely in conjunction with devices provided by
+ *    ModalAI Inc.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ ******************************************************************************/
+
+
+#include <stdio.h>
+#include <math.h>
+#include <voxl_rangefinder_interface.h>
+
+#include "consistency.h"
+#include "common.h"
+#include "config_file.h"
+#include "geometry.h"
+
+#define MAX_PAIRS	(MAX_SENSORS*(MAX_SENSORS-1)/2)
+
+
+/**
+ * two sensors whose cones share the direction halfway between their axes.
+ * A surface in the overlap facing that shared direction is seen by both so
+ * its depth along it should come out the same from either reading. A
+ * surface tilted by some incidence angle moves the depths apart by the
+ * sideways distance between the two hit points times the tangent of it.
+ */
+typedef struct pair_t{
+	int a;
+	int b;
+	float u[3];			///< unit direction halfway between the two axes
+	float ca;			///< cosine between a's axis and the shared direction
+	float cb;
+	float la_mm;		///< a's location projected on the shared direction
+	float lb_mm;
+} pair_t;
+
+
+static int n_pairs = 0;
+static pair_t pairs[MAX_PAIRS];
+static float tan_max_incidence;
+static uint64_t n_checked = 0;
+static uint64_t n_inconsistent = 0;
+
+
+int consistency_init(void)
+{
+	n_pairs = 0;
+	if(!en_consistency_check) return 0;
+
+	if(consistency_max_incidence_deg<0.0f || consistency_max_incidence_deg>=90.0f){
+		fprintf(stderr, "ERROR in %s, consistency_max_incidence_deg must be in 0-90\n", __FUNCTION__);
+		return -1;
+	}
+	tan_max_incidence = tanf(consistency_max_incidence_deg*(float)M_PI/180.0f);
+
+	for(int a=0; a<geom.n; a++){
+		if(!geom.has_dir[a]) continue;
+		for(int b=a+1; b<geom.n; b++){
+			if(!geom.has_dir[b]) continue;
+
+			float u[3];
+			for(int k=0; k<3; k++) u[k] = geom.dir[k][a] + geom.dir[k][b];
+			float len = sqrtf(u[0]*u[0] + u[1]*u[1] + u[2]*u[2]);
+			if(len<=0.0f) continue;
+			for(int k=0; k<3; k++) u[k] /= len;
+
+			// the halfway direction has to be inside both cones to overlap
+			float ca = u[0]*geom.dir[0][a] + u[1]*geom.dir[1][a] + u[2]*geom.dir[2][a];
+			float cb = u[0]*geom.dir[0][b] + u[1]*geom.dir[1][b] + u[2]*geom.dir[2][b];
+			if(ca < cosf(geom.half_fov_rad[a])) continue;
+			if(cb < cosf(geom.half_fov_rad[b])) continue;
+
+			pair_t* p = &pairs[n_pairs];
+			p->a = a;
+			p->b = b;
+			for(int k=0; k<3; k++) p->u[k] = u[k];
+			p->ca = ca;
+			p->cb = cb;
+			p->la_mm = 1000.0f*(u[0]*geom.loc[0][a] + u[1]*geom.loc[1][a] + u[2]*geom.loc[2][a]);
+			p->lb_mm = 1000.0f*(u[0]*geom.loc[0][b] + u[1]*geom.loc[1][b] + u[2]*geom.loc[2][b]);
+			n_pairs++;
+			printf("checking consistency between sensors %d and %d\n", \
+						enabled_sensors[a].sensor_id, enabled_sensors[b].sensor_id);
+		}
+	}
+	return 0;
+}
+
+
+static void _mark(rangefinder_data_t* d, rangefinder_sample_ext_t* s, float err_mm)
+{
+	if(consistency_reject){
+		d->distance_m = -1;
+		s->sample.distance_mm = -1;
+		s->sample.status = RANGEFINDER_STATUS_INCONSISTENT;
+		return;
+	}
+
+	// uncertainty is 2 sigma, grow it so the disagreement is inside it
+	if(s->sample.uncertainty_mm < (int)err_mm){
+		s->sample.uncertainty_mm = (int)ceilf(err_mm);
+		d->uncertainty_m = err_mm/1000.0f;
+	}
+}
+
+
+int consistency_check(rangefinder_data_t* d, rangefinder_sample_ext_t* s, __attribute__((unused)) int n)
+{
+	int found = 0;
+
+	for(int i=0; i<n_pairs; i++){
+		int a = pairs[i].a;
+		int b = pairs[i].b;
+		rangefinder_sample_t* sa = &s[a].sample;
+		rangefinder_sample_t* sb = &s[b].sample;
+		if(sa->status!=RANGEFINDER_STATUS_VALID) continue;
+		if(sb->status!=RANGEFINDER_STATUS_VALID) continue;
+
+		// depth of each hit along the shared direction and its sigma
+		pair_t* p = &pairs[i];
+		float za = p->la_mm + p->ca*sa->distance_mm;
+		float zb = p->lb_mm + p->cb*sb->distance_mm;
+		float ua = 0.5f*p->ca*sa->uncertainty_mm;
+		float ub = 0.5f*p->cb*sb->uncertainty_mm;
+		float err = fabsf(za-zb);
+
+		// sideways distance between the two hit points, across the shared
+		// direction. Surfaces tilted up to the max incidence are allowed to
+		// differ in depth by this times the tangent of their tilt.
+		float lat[3];
+		for(int k=0; k<3; k++){
+			float ha = 1000.0f*geom.loc[k][a] + sa->distance_mm*geom.dir[k][a];
+			float hb = 1000.0f*geom.loc[k][b] + sb->distance_mm*geom.dir[k][b];
+			lat[k] = ha - hb;
+		}
+		float along = lat[0]*p->u[0] + lat[1]*p->u[1] + lat[2]*p->u[2];
+		for(int k=0; k<3; k++) lat[k] -= along*p->u[k];
+		float lat_mm = sqrtf(lat[0]*lat[0] + lat[1]*lat[1] + lat[2]*lat[2]);
+
+		float limit = consistency_sigma*sqrtf(ua*ua + ub*ub) + lat_mm*tan_max_incidence;
+
+		n_checked++;
+		if(err <= limit) continue;
+
+		// can't tell which one is wrong, multipath reads long and crosstalk
+		// reads short, so treat both the same
+		_mark(&d[a], &s[a], err);
+		_mark(&d[b], &s[b], err);
+		n_inconsistent++;
+		found++;
+	}
+	return found;
+}
+
+
+void consistency_print_stats(void)
+{
+	if(n_pairs==0 || n_checked==0) return;
+
+	printf("consistency: %llu of %llu pair checks disagreed\n", \
+			(unsigned long long)n_inconsistent, (unsigned long long)n_checked);
+	n_checked = 0;
+	n_inconsistent = 0;
+	return;
+}
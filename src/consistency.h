@@ -0,0 +1,60 @@
+/*******************************************************************************
+ * Copyright 2023 ModalAI Inc.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * 4. The Software is used solely in conjunction with devices provided by
+ *    ModalAI Inc.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ ******************************************************************************/
+
+
+#ifndef CONSISTENCY_H
+#define CONSISTENCY_H
+
+#include <voxl_rangefinder_interface.h>
+
+// find the sensor pairs with overlapping fields of view, call after geometry_init()
+int consistency_init(void);
+
+/**
+ * @brief      check every overlapping pair for readings that can't both be
+ *             true, allowing for surfaces tilted up to
+ *             consistency_max_incidence_deg. Disagreeing readings have their
+ *             uncertainty inflated to cover the disagreement or, with
+ *             consistency_reject, are marked RANGEFINDER_STATUS_INCONSISTENT.
+ *             Modifies d and s in place.
+ *
+ * @return     number of inconsistent pairs found
+ */
+int consistency_check(rangefinder_data_t* d, rangefinder_sample_ext_t* s, int n);
+
+// print and reset the count of inconsistent pairs, only from the thread
+// running the pipeline stages since that is the one updating them
+void consistency_print_stats(void);
+
+
+#endif // end #define CONSISTENCY_H
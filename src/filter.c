@@ -0,0 +1,237 @@
+/*******************************************************************************
+ * Copyright 2023 ModalAI Inc.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * 4. The Software is used solely in conjunction with devices provided by
+ *    ModalAI Inc.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ ******************************************************************************/
+
+
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+#include <modal_pipe_server.h>
+#include <voxl_rangefinder_interface.h>
+
+#include "filter.h"
+#include "common.h"
+#include "config_file.h"
+
+// restart a filter after going this long without a valid reading
+#define MAX_GAP_NS			500000000
+
+// scales median absolute deviation to a standard deviation for gaussian noise
+#define MAD_TO_SD			1.4826f
+
+// kalman gate in standard deviations, and how many readings in a row it may
+// reject before assuming the scene really changed and restarting
+#define KF_GATE_SD			3.0f
+#define KF_MAX_REJECTS		3
+
+
+// fixed-size state for one sensor, which parts get used depends on the type
+typedef struct filter_state_t{
+	int64_t last_ns;				///< time of the last valid reading, 0 to restart
+	// median and hampel window
+	int n;
+	int head;
+	float val[FILTER_MAX_WINDOW];
+	// kalman
+	float x;						///< distance, m
+	float P;						///< variance, m^2
+	int n_rejects;					///< consecutive readings outside the gate
+} filter_state_t;
+
+
+static int ch = -1;
+static filter_state_t state[MAX_SENSORS];
+
+
+int filter_init(void)
+{
+	int en = 0;
+	for(int i=0; i<n_enabled_sensors; i++){
+		if(enabled_filters[i].type!=FILTER_NONE) en = 1;
+	}
+	if(!en) return 0;
+
+	memset(state, 0, sizeof(state));
+	ch = pipe_server_get_next_available_channel();
+
+	pipe_info_t info = { \
+		.name        = RANGEFINDER_FILTERED_PIPE_NAME,\
+		.location    = RANGEFINDER_FILTERED_PIPE_LOCATION ,\
+		.type        = "rangefinder_data_t",\
+		.server_name = PROCESS_NAME,\
+		.size_bytes  = RANGEFINDER_RECOMMENDED_PIPE_SIZE};
+
+	return pipe_server_create(ch, info, 0);
+}
+
+
+int filter_num_clients(void)
+{
+	if(ch<0) return 0;
+	return pipe_server_get_num_clients(ch);
+}
+
+
+// window is at most 9 long so insertion sort on a copy is plenty
+static float _median(const float* in, int n)
+{
+	float v[FILTER_MAX_WINDOW];
+	for(int i=0; i<n; i++){
+		float x = in[i];
+		int j = i;
+		while(j>0 && v[j-1]>x){
+			v[j] = v[j-1];
+			j--;
+		}
+		v[j] = x;
+	}
+	if(n&1) return v[n/2];
+	return 0.5f*(v[n/2-1] + v[n/2]);
+}
+
+
+static void _push(filter_state_t* f, int window, float z)
+{
+	f->val[f->head] = z;
+	f->head = (f->head+1)%window;
+	if(f->n<window) f->n++;
+}
+
+
+// hampel identifier: keep the reading unless it's further from the window
+// median than k robust standard deviations, in which case use the median.
+// The reading's own uncertainty sets a floor so a flat window with MAD=0
+// doesn't reject ordinary noise.
+static void _hampel(filter_state_t* f, filter_config_t* c, rangefinder_data_t* d)
+{
+	float med = _median(f->val, f->n);
+	float dev[FILTER_MAX_WINDOW];
+	for(int i=0; i<f->n; i++) dev[i] = fabsf(f->val[i]-med);
+	float sd = MAD_TO_SD*_median(dev, f->n);
+
+	float thresh = c->hampel_k*sd;
+	if(thresh < d->uncertainty_m) thresh = d->uncertainty_m;
+
+	if(fabsf(d->distance_m-med) > thresh){
+		d->distance_m = med;
+		if(d->uncertainty_m < 2.0f*sd) d->uncertainty_m = 2.0f*sd;
+	}
+}
+
+
+// 1D kalman filter with a random walk model, uncertainty_m is 2 sigma
+static void _kalman(filter_state_t* f, filter_config_t* c, rangefinder_data_t* d, float dt)
+{
+	float z = d->distance_m;
+	float sd = 0.5f*d->uncertainty_m;
+	if(sd<0.001f) sd = 0.001f;
+	float R = sd*sd;
+
+	// first reading after a restart
+	if(f->P<=0.0f){
+		f->x = z;
+		f->P = R;
+		f->n_rejects = 0;
+		return;
+	}
+
+	// random walk, variance grows linearly with time
+	f->P += c->process_noise*c->process_noise*dt;
+
+	float y = z - f->x;
+	float S = f->P + R;
+	if(y*y > KF_GATE_SD*KF_GATE_SD*S){
+		f->n_rejects++;
+		if(f->n_rejects>KF_MAX_REJECTS){
+			f->x = z;
+			f->P = R;
+			f->n_rejects = 0;
+		}
+		else{
+			d->distance_m = -1;
+			return;
+		}
+	}
+	else{
+		float K = f->P/S;
+		f->x += K*y;
+		f->P *= (1.0f-K);
+		f->n_rejects = 0;
+	}
+
+	d->distance_m = f->x;
+	d->uncertainty_m = 2.0f*sqrtf(f->P);
+}
+
+
+int filter_publish(rangefinder_data_t* d, int n)
+{
+	if(ch<0) return 0;
+
+	// keep the filters running even without clients so they're warm
+	rangefinder_data_t out[MAX_SENSORS];
+	memcpy(out, d, sizeof(rangefinder_data_t)*n);
+
+	for(int i=0; i<n; i++){
+		filter_config_t* c = &enabled_filters[i];
+		filter_state_t* f = &state[i];
+		rangefinder_data_t* o = &out[i];
+
+		if(c->type==FILTER_NONE || o->distance_m<0.0f) continue;
+
+		int64_t t = o->timestamp_ns;
+		if(f->last_ns==0 || t-f->last_ns>MAX_GAP_NS){
+			memset(f, 0, sizeof(filter_state_t));
+		}
+		float dt = f->last_ns==0 ? 0.0f : (float)(t-f->last_ns)/1000000000.0f;
+		f->last_ns = t;
+
+		switch(c->type){
+		case FILTER_MEDIAN:
+			_push(f, c->window, o->distance_m);
+			o->distance_m = _median(f->val, f->n);
+			break;
+		case FILTER_HAMPEL:
+			_push(f, c->window, o->distance_m);
+			_hampel(f, c, o);
+			break;
+		case FILTER_KALMAN:
+			_kalman(f, c, o, dt);
+			break;
+		default:
+			break;
+		}
+	}
+
+	if(pipe_server_get_num_clients(ch)<=0) return 0;
+	return pipe_server_write(ch, out, sizeof(rangefinder_data_t)*n);
+}
@@ -0,0 +1,200 @@
+/*******************************************************************************
+ * Copyright 2023 ModalAI Inc.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * 4. The Software is used solely in conjunction with devices provided by
+ *    ModalAI Inc.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ ******************************************************************************/
+
+
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <errno.h>
+#include <pthread.h>
+#include <modal_pipe_server.h>
+#include <voxl_rangefinder_interface.h>
+
+#include "frame.h"
+#include "common.h"
+#include "config_file.h"
+#include "sample_pipe.h"
+
+
+// latest reading from each sensor, written by the pipeline, read by the thread
+typedef struct latest_t{
+	int64_t t_ns;				///< time of the latest valid reading, 0 if none yet
+	int32_t distance_mm;
+	int16_t uncertainty_mm;
+	uint8_t status;				///< status of the latest reading, valid or not
+} latest_t;
+
+
+static int ch = -1;
+static int n_sensors = 0;
+static latest_t latest[RANGEFINDER_FRAME_MAX_SENSORS];
+static uint32_t fresh_mask = 0;
+static pthread_mutex_t mtx = PTHREAD_MUTEX_INITIALIZER;
+
+static volatile int running = 0;
+static pthread_t thread;
+
+
+static void _assemble(rangefinder_frame_t* f, int64_t now_ns)
+{
+	int64_t max_age_ns = (int64_t)frame_max_age_ms*1000000;
+
+	memset(f, 0, sizeof(rangefinder_frame_t));
+	f->magic_number	= RANGEFINDER_FRAME_MAGIC_NUMBER;
+	f->timestamp_ns	= now_ns;
+	f->n_sensors	= n_sensors;
+
+	pthread_mutex_lock(&mtx);
+	f->fresh_mask = fresh_mask;
+	fresh_mask = 0;
+	for(int i=0; i<n_sensors; i++){
+		latest_t* l = &latest[i];
+		f->status[i] = l->status;
+		if(l->t_ns==0){
+			f->distance_mm[i]	= -1;
+			f->uncertainty_mm[i]= -1;
+			f->age_us[i]		= UINT32_MAX;
+			continue;
+		}
+		int64_t age_ns = now_ns - l->t_ns;
+		if(age_ns<0) age_ns = 0;
+		f->distance_mm[i]	= l->distance_mm;
+		f->uncertainty_mm[i]= l->uncertainty_mm;
+		f->age_us[i]		= age_ns/1000 > UINT32_MAX ? UINT32_MAX : (uint32_t)(age_ns/1000);
+		if(age_ns <= max_age_ns) f->valid_mask |= (1u<<i);
+	}
+	pthread_mutex_unlock(&mtx);
+}
+
+
+static void* _frame_thread_func(__attribute__((unused)) void* arg)
+{
+	int64_t period_ns = (int64_t)(1000000000.0/(double)frame_rate_hz);
+	uint32_t frame_id = 0;
+
+	// sleep until absolute deadlines so the rate doesn't drift
+	struct timespec next;
+	clock_gettime(CLOCK_MONOTONIC, &next);
+
+	while(running){
+		int64_t t = (int64_t)next.tv_sec*1000000000 + next.tv_nsec + period_ns;
+		next.tv_sec  = t/1000000000;
+		next.tv_nsec = t%1000000000;
+		while(clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &next, NULL)==EINTR);
+		if(!running) break;
+
+		// if we fell a whole period behind, skip ahead rather than bursting
+		int64_t now_ns = time_monotonic_ns();
+		if(now_ns - t > period_ns){
+			next.tv_sec  = now_ns/1000000000;
+			next.tv_nsec = now_ns%1000000000;
+		}
+
+		if(pipe_server_get_num_clients(ch)<=0) continue;
+
+		rangefinder_frame_t f;
+		_assemble(&f, now_ns);
+		f.frame_id = frame_id++;
+		pipe_server_write(ch, &f, sizeof(rangefinder_frame_t));
+	}
+	return NULL;
+}
+
+
+int frame_init(void)
+{
+	if(frame_rate_hz<=0.0f) return 0;
+
+	if(n_enabled_sensors>RANGEFINDER_FRAME_MAX_SENSORS){
+		fprintf(stderr, "ERROR in %s, can't fit %d sensors in a frame\n", __FUNCTION__, n_enabled_sensors);
+		return -1;
+	}
+	n_sensors = n_enabled_sensors;
+	memset(latest, 0, sizeof(latest));
+	for(int i=0; i<n_sensors; i++) latest[i].status = RANGEFINDER_STATUS_NO_DATA;
+
+	ch = pipe_server_get_next_available_channel();
+
+	pipe_info_t info = { \
+		.name        = RANGEFINDER_FRAME_PIPE_NAME,\
+		.location    = RANGEFINDER_FRAME_PIPE_LOCATION ,\
+		.type        = "rangefinder_frame_t",\
+		.server_name = PROCESS_NAME,\
+		.size_bytes  = RANGEFINDER_RECOMMENDED_PIPE_SIZE};
+
+	if(pipe_server_create(ch, info, 0)) return -1;
+	if(sample_pipe_add_sensors_to_info(ch)) return -1;
+
+	running = 1;
+	if(pthread_create(&thread, NULL, _frame_thread_func, NULL)){
+		fprintf(stderr, "ERROR failed to start frame thread\n");
+		running = 0;
+		return -1;
+	}
+	return 0;
+}
+
+
+int frame_num_clients(void)
+{
+	if(ch<0) return 0;
+	return pipe_server_get_num_clients(ch);
+}
+
+
+int frame_update(rangefinder_sample_ext_t* s, int n)
+{
+	if(ch<0) return 0;
+
+	pthread_mutex_lock(&mtx);
+	for(int i=0; i<n && i<n_sensors; i++){
+		rangefinder_sample_t* x = &s[i].sample;
+		latest[i].status = x->status;
+		if(x->status!=RANGEFINDER_STATUS_VALID) continue;
+		latest[i].t_ns				= x->timestamp_ns;
+		latest[i].distance_mm		= x->distance_mm;
+		latest[i].uncertainty_mm	= x->uncertainty_mm;
+		fresh_mask |= (1u<<i);
+	}
+	pthread_mutex_unlock(&mtx);
+	return 0;
+}
+
+
+void frame_stop(void)
+{
+	if(!running) return;
+	running = 0;
+	pthread_join(thread, NULL);
+	return;
+}
@@ -0,0 +1,112 @@
+/*******************************************************************************
+ * Copyright 2023 ModalAI Inc.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * 4. The Software is used solely in conjunction with devices provided by
+ *    ModalAI Inc.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ ******************************************************************************/
+
+
+#include <stdio.h>
+#include <math.h>
+#include <string.h>
+
+#include "geometry.h"
+#include "config_file.h"
+
+
+geometry_t geom;
+
+
+static void _cross(const float a[3], const float b[3], float out[3])
+{
+	out[0] = a[1]*b[2] - a[2]*b[1];
+	out[1] = a[2]*b[0] - a[0]*b[2];
+	out[2] = a[0]*b[1] - a[1]*b[0];
+	return;
+}
+
+
+static float _normalize(float v[3])
+{
+	float norm = sqrtf(v[0]*v[0] + v[1]*v[1] + v[2]*v[2]);
+	if(norm < 1e-6f) return 0.0f;
+	v[0] /= norm;
+	v[1] /= norm;
+	v[2] /= norm;
+	return norm;
+}
+
+
+int geometry_init(void)
+{
+	int i, j, k;
+
+	memset(&geom, 0, sizeof(geom));
+	geom.n = n_enabled_sensors;
+
+	for(i=0; i<n_enabled_sensors; i++){
+		rangefinder_config_t* s = &enabled_sensors[i];
+
+		float d[3] = {s->direction_wrt_body[0], s->direction_wrt_body[1], s->direction_wrt_body[2]};
+		for(j=0; j<3; j++) geom.loc[j][i] = s->location_wrt_body[j];
+		geom.half_fov_rad[i] = s->fov_deg * (float)M_PI / 360.0f;
+
+		if(_normalize(d) == 0.0f){
+			fprintf(stderr, "WARNING sensor id %d has no direction_wrt_body, it won't appear in spatial outputs\n", s->sensor_id);
+			continue;
+		}
+		for(j=0; j<3; j++) geom.dir[j][i] = d[j];
+		geom.has_dir[i] = 1;
+
+		// two unit vectors perpendicular to the direction, use whichever of
+		// z or x is further from the direction to build them
+		float helper[3] = {0.0f, 0.0f, 1.0f};
+		if(fabsf(d[2]) > 0.9f){
+			helper[0] = 1.0f;
+			helper[2] = 0.0f;
+		}
+		float u[3], v[3];
+		_cross(d, helper, u);
+		_normalize(u);
+		_cross(d, u, v);
+
+		// tilt the direction by half the fov toward +u, +v, -u, -v
+		float c = cosf(geom.half_fov_rad[i]);
+		float sn = sinf(geom.half_fov_rad[i]);
+		const float su[GEOMETRY_N_EDGES] = {1.0f, 0.0f, -1.0f,  0.0f};
+		const float sv[GEOMETRY_N_EDGES] = {0.0f, 1.0f,  0.0f, -1.0f};
+		for(k=0; k<GEOMETRY_N_EDGES; k++){
+			for(j=0; j<3; j++){
+				geom.edge[k][j][i] = c*d[j] + sn*(su[k]*u[j] + sv[k]*v[j]);
+			}
+		}
+	}
+
+	return 0;
+}
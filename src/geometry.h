@@ -0,0 +1,63 @@
+/*******************************************************************************
+ * Copyright 2023 ModalAI Inc.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * 4. The Software is used solely in conjunction with devices provided by
+ *    ModalAI Inc.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ ******************************************************************************/
+
+
+#ifndef GEOMETRY_H
+#define GEOMETRY_H
+
+#include "common.h"
+
+// number of points used to outline each sensor's fov cone
+#define GEOMETRY_N_EDGES	4
+
+/**
+ * geometry of the enabled sensors precomputed once at startup. Each quantity
+ * is stored as one array per axis, indexed the same as enabled_sensors, so
+ * loops over all sensors can be vectorized by the compiler.
+ */
+typedef struct geometry_t{
+	int n;											///< number of enabled sensors
+	float loc[3][MAX_SENSORS];						///< location wrt body, [axis][sensor]
+	float dir[3][MAX_SENSORS];						///< unit direction wrt body, 0 if not configured
+	float edge[GEOMETRY_N_EDGES][3][MAX_SENSORS];	///< unit vectors along the fov cone edges
+	float half_fov_rad[MAX_SENSORS];				///< half of fov_deg in radians
+	int has_dir[MAX_SENSORS];						///< 0 if direction_wrt_body was left as zeros
+} geometry_t;
+
+extern geometry_t geom;
+
+// fill in geom from the enabled_sensors array, call after read_config_file()
+int geometry_init(void);
+
+
+#endif // end #define GEOMETRY_H
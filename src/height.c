@@ -0,0 +1,156 @@
+/*******************************************************************************
+ * Copyright 2023 ModalAI Inc.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * 4. The Software is used solely in conjunction with devices provided by
+ *    ModalAI Inc.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ ******************************************************************************/
+
+
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+#include <modal_pipe_server.h>
+#include <voxl_rangefinder_interface.h>
+
+#include "height.h"
+#include "attitude.h"
+#include "predictor.h"
+#include "geometry.h"
+#include "common.h"
+#include "config_file.h"
+
+// sensors pointing within 60 degrees of straight down count as downward
+#define MIN_DOWN_COMPONENT	0.5f
+
+static int ch = -1;
+static int n_down = 0;
+static int down_index[MAX_SENSORS];		// index into enabled_sensors
+static float cos_max_tilt;
+
+
+int height_init(void)
+{
+	// the predictor needs the heights even if the pipe isn't enabled
+	if(!en_height && !en_height_predictor) return 0;
+
+	n_down = 0;
+	for(int i=0; i<geom.n; i++){
+		if(geom.has_dir[i] && geom.dir[2][i] >= MIN_DOWN_COMPONENT){
+			down_index[n_down++] = i;
+		}
+	}
+	if(n_down==0){
+		fprintf(stderr, "WARNING en_height is set but there are no downward sensors\n");
+		return 0;
+	}
+	cos_max_tilt = cosf(height_max_tilt_deg * (float)M_PI / 180.0f);
+	if(!en_height) return 0;
+
+	ch = pipe_server_get_next_available_channel();
+
+	pipe_info_t info = { \
+		.name        = RANGEFINDER_HEIGHT_PIPE_NAME,\
+		.location    = RANGEFINDER_HEIGHT_PIPE_LOCATION ,\
+		.type        = "rangefinder_height_t",\
+		.server_name = PROCESS_NAME,\
+		.size_bytes  = RANGEFINDER_RECOMMENDED_PIPE_SIZE};
+
+	return pipe_server_create(ch, info, 0);
+}
+
+
+int height_num_clients(void)
+{
+	if(ch<0) return 0;
+	return pipe_server_get_num_clients(ch);
+}
+
+
+int height_publish(rangefinder_sample_ext_t* s, __attribute__((unused)) int n)
+{
+	int has_clients = ch>=0 && pipe_server_get_num_clients(ch)>0;
+	if(n_down==0 || (!has_clients && !en_height_predictor)) return 0;
+
+	rangefinder_height_t out[MAX_SENSORS];
+	memset(out, 0, sizeof(rangefinder_height_t)*n_down);
+
+	// all sensors in a sample share a timestamp so one lookup does
+	int64_t t_ns = s[0].sample.timestamp_ns;
+	float roll = 0.0f, pitch = 0.0f, yaw = 0.0f;
+	int has_att = attitude_get(t_ns, ATTITUDE_MAX_AGE_NS, &roll, &pitch, &yaw)==0;
+
+	// the z row of the body to level rotation, yaw doesn't change height
+	float sr = sinf(roll);
+	float cr = cosf(roll);
+	float sp = sinf(pitch);
+	float cp = cosf(pitch);
+	float rz[3] = {-sp, cp*sr, cp*cr};
+
+	for(int k=0; k<n_down; k++){
+		int i = down_index[k];
+		rangefinder_sample_t* d = &s[i].sample;
+		rangefinder_height_t* h = &out[k];
+
+		h->magic_number	= RANGEFINDER_HEIGHT_MAGIC_NUMBER;
+		h->sensor_id	= enabled_sensors[i].sensor_id;
+		h->timestamp_ns	= t_ns;
+		h->height_m		= -1.0f;
+		h->range_m		= -1.0f;
+		h->status		= d->status;
+
+		if(d->status != RANGEFINDER_STATUS_VALID) continue;
+		h->range_m = (float)d->distance_mm * 0.001f;
+
+		if(!has_att){
+			h->status = RANGEFINDER_STATUS_NO_ATTITUDE;
+			continue;
+		}
+		h->roll_rad = roll;
+		h->pitch_rad = pitch;
+
+		// vertical component of the ray and of the sensor offset
+		float ray_z = rz[0]*geom.dir[0][i] + rz[1]*geom.dir[1][i] + rz[2]*geom.dir[2][i];
+		float loc_z = rz[0]*geom.loc[0][i] + rz[1]*geom.loc[1][i] + rz[2]*geom.loc[2][i];
+		if(ray_z > 1.0f) ray_z = 1.0f;
+		h->tilt_deg = acosf(ray_z) * 180.0f / (float)M_PI;
+
+		if(ray_z < cos_max_tilt){
+			h->status = RANGEFINDER_STATUS_TILT_LIMIT;
+			continue;
+		}
+		h->height_m = h->range_m*ray_z + loc_z;
+
+		if(en_height_predictor && d->uncertainty_mm>=0){
+			predictor_add_height(t_ns, h->height_m, (float)d->uncertainty_mm*0.0005f*ray_z);
+		}
+	}
+
+	if(!has_clients) return 0;
+	return pipe_server_write(ch, out, sizeof(rangefinder_height_t)*n_down);
+}
@@ -0,0 +1,187 @@
+/*******************************************************************************
+ * Copyright 2023 ModalAI Inc.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * 4. The Software is used solely in conjunction with devices provided by
+ *    ModalAI Inc.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ ******************************************************************************/
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <modal_pipe_server.h>
+#include <voxl_rangefinder_interface.h>
+
+#include "history.h"
+#include "common.h"
+#include "config_file.h"
+
+
+static int ch = -1;
+static rangefinder_data_t* ring = NULL;
+static int capacity = 0;	// in packets
+static int head = 0;		// next index to write
+static int count = 0;		// number of valid packets in the ring
+static int en_debug = 0;
+
+// clients waiting for a backfill, kept by name since libmodal_pipe reuses
+// client ids after a disconnect
+static char pending[MAX_PIPE_CLIENTS][MODAL_PIPE_MAX_NAME_LEN];
+static int n_pending = 0;
+static pthread_mutex_t mtx = PTHREAD_MUTEX_INITIALIZER;
+
+
+void history_set_en_debug(int en)
+{
+	en_debug = en;
+	return;
+}
+
+
+int history_init(int channel)
+{
+	ch = channel;
+	if(history_s<=0.0f || n_enabled_sensors<1) return 0;
+
+	// we can't sample faster than the timing budget so this is an upper bound
+	int n_cycles = (int)((history_s*1000.0f)/vl53l1x_timing_budget_ms) + 1;
+	capacity = n_cycles * n_enabled_sensors;
+
+	ring = malloc(capacity * sizeof(rangefinder_data_t));
+	if(ring==NULL){
+		fprintf(stderr, "ERROR in %s, failed to allocate %d packets\n", __FUNCTION__, capacity);
+		capacity = 0;
+		return -1;
+	}
+	printf("keeping %.1fs of history in %d packets\n", (double)history_s, capacity);
+	return 0;
+}
+
+
+// write the ring oldest to newest to one client, this may take two writes
+// if the ring wraps. Call with mtx held.
+static void _send_to_client(int id)
+{
+	int start = head - count;
+	if(start<0){
+		start += capacity;
+		pipe_server_write_to_client(ch, id, &ring[start], (capacity-start)*sizeof(rangefinder_data_t));
+		start = 0;
+	}
+	if(head>start){
+		pipe_server_write_to_client(ch, id, &ring[start], (head-start)*sizeof(rangefinder_data_t));
+	}
+	if(en_debug) printf("sent %d packets of history to client %d\n", count, id);
+	return;
+}
+
+
+int history_add(rangefinder_data_t* d, int n)
+{
+	if(capacity==0) return 0;
+
+	pthread_mutex_lock(&mtx);
+
+	// backfills go out here rather than from the control thread so they
+	// can't interleave with live packets. The ring holds everything up to
+	// the previous cycle and this cycle is published after us.
+	// A client that disconnected since asking won't resolve any more.
+	for(int i=0; i<n_pending; i++){
+		int id = pipe_server_get_client_id_from_name(ch, pending[i]);
+		if(id>=0) _send_to_client(id);
+	}
+	n_pending = 0;
+
+	for(int i=0; i<n; i++){
+		ring[head] = d[i];
+		head++;
+		if(head>=capacity) head = 0;
+	}
+	count += n;
+	if(count>capacity) count = capacity;
+	pthread_mutex_unlock(&mtx);
+	return 0;
+}
+
+
+int history_handle_control(char* cmd)
+{
+	char name[MODAL_PIPE_MAX_NAME_LEN];
+
+	if(strncmp(cmd, "send_history", 12)) return 1;
+	if(sscanf(cmd, "send_history %31s", name)!=1){
+		fprintf(stderr, "ERROR invalid send_history command: %s\n", cmd);
+		return -1;
+	}
+	if(capacity==0){
+		fprintf(stderr, "ERROR send_history: history is disabled, set history_s in the config file\n");
+		return -1;
+	}
+
+	if(pipe_server_get_client_id_from_name(ch, name)<0){
+		fprintf(stderr, "ERROR send_history: no client named %s\n", name);
+		return -1;
+	}
+
+	// queue it for the publishing stage, once per client
+	int ret = 0;
+	pthread_mutex_lock(&mtx);
+	int i;
+	for(i=0; i<n_pending; i++){
+		if(strcmp(pending[i], name)==0) break;
+	}
+	if(i==n_pending){
+		if(n_pending<MAX_PIPE_CLIENTS){
+			strcpy(pending[n_pending], name);
+			n_pending++;
+		}
+		else{
+			fprintf(stderr, "ERROR send_history: too many requests queued\n");
+			ret = -1;
+		}
+	}
+	pthread_mutex_unlock(&mtx);
+
+	return ret;
+}
+
+
+void history_cleanup(void)
+{
+	pthread_mutex_lock(&mtx);
+	free(ring);
+	ring = NULL;
+	capacity = 0;
+	count = 0;
+	head = 0;
+	n_pending = 0;
+	pthread_mutex_unlock(&mtx);
+	return;
+}
@@ -0,0 +1,68 @@
+/*******************************************************************************
+ * Copyright 2023 ModalAI Inc.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * 4. The Software is used solely in conjunction with devices provided by
+ *    ModalAI Inc.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ ******************************************************************************/
+
+#ifndef HISTORY_H
+#define HISTORY_H
+
+#include <voxl_rangefinder_interface.h>
+
+/**
+ * Keeps the last history_s seconds of rangefinder_data_t packets in a ring
+ * buffer allocated once at startup. A newly connected client can ask for an
+ * immediate backfill with the control command:
+ *   send_history {client_name}
+ * to warm up its filters without waiting for new data.
+ */
+
+#define HISTORY_CONTROL_COMMANDS "send_history"
+
+// print every backfill sent
+void history_set_en_debug(int en);
+
+// allocate the ring, does nothing if history_s is 0
+int history_init(int ch);
+
+// send any queued backfills then add one cycle's worth of packets to the ring.
+// Runs in the publishing stage just before the live write so a backfill ends
+// right where live data picks up. It may repeat packets the client already
+// got between connecting and asking, drop those by timestamp.
+int history_add(rangefinder_data_t* d, int n);
+
+// returns 0 if the command was handled, 1 if it's not a send_history command,
+// or -1 if it was but couldn't be handled
+int history_handle_control(char* cmd);
+
+void history_cleanup(void);
+
+
+#endif // end #define HISTORY_H
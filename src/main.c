@@ -44,12 +44,31 @@
 #include <modal_start_stop.h>
 #include <modal_pipe_server.h>
 #include <voxl_rangefinder_interface.h>
+#include <voxl_rangefinder.h>
 
 #include "mavlink.h"
 #include "common.h"
 #include "config_file.h"
-#include "vl53l1x.h"
-#include "vl53l1x_registers.h"
+#include "sample_pipe.h"
+#include "sensor_pipes.h"
+#include "client_rate.h"
+#include "history.h"
+#include "shm_latest.h"
+#include "geometry.h"
+#include "point_cloud.h"
+#include "timesync.h"
+#include "uart_mavlink.h"
+#include "height.h"
+#include "predictor.h"
+#include "range_rate.h"
+#include "filter.h"
+#include "pipeline.h"
+#include "oversample.h"
+#include "consistency.h"
+#include "frame.h"
+#include "voxel_map.h"
+#include "pose.h"
+#include "world_points.h"
 
 
 
@@ -58,6 +77,9 @@ static int en_timing = 0;
 static int en_config_mode = 0;
 static int config_arrangement = 0;
 
+// all the sensors on our bus, set up from the config file
+static rangefinder_ctx_t ctx;
+
 
 
 
@@ -112,7 +134,8 @@ static int __parse_opts(int argc, char* argv[])
 
 		case 'd':
 			en_debug = 1;
-			vl53l1x_set_en_debug(1);
+			rangefinder_set_en_debug(1);
+			history_set_en_debug(1);
 			break;
 
 		case 'h':
@@ -133,191 +156,67 @@ static int __parse_opts(int argc, char* argv[])
 }
 
 
-static int64_t _apps_time_monotonic_ns(void)
-{
-	struct timespec ts;
-	if(clock_gettime(CLOCK_MONOTONIC, &ts)){
-		fprintf(stderr,"ERROR calling clock_gettime\n");
-		return -1;
-	}
-	return (int64_t)ts.tv_sec*1000000000 + (int64_t)ts.tv_nsec;
-}
-
-
 
-static void _quit(int ret)
+// commands sent to the main rangefinders pipe
+static void _control_pipe_cb(__attribute__((unused)) int ch, char* string, \
+					int bytes, __attribute__((unused)) void* context)
 {
-	if(voxl_i2c_close(bus)){
-		fprintf(stderr, "failed to close bus\n");
-	}
-	pipe_server_close_all();
-	remove_pid_file(PROCESS_NAME);
-	printf("exiting\n");
-	exit(ret);
+	// make sure the command is null terminated before parsing it
+	char cmd[128];
+	if(bytes>=(int)sizeof(cmd)) bytes = sizeof(cmd)-1;
+	memcpy(cmd, string, bytes);
+	cmd[bytes] = 0;
+
+	// modules return 1 for commands that aren't theirs and print their own
+	// errors for the ones that are
+	if(client_rate_handle_control(cmd)<1) return;
+	if(history_handle_control(cmd)<1) return;
+
+	fprintf(stderr, "WARNING unknown control command: %s\n", cmd);
 	return;
 }
 
 
-// this is for TCA9548A i2c multiplexer
-// TODO add support for multiple muxers in the future
-static int _set_multiplexer(int mux_ch, uint8_t addr)
-{
-	if(n_mux_sensors>0){
-
-
-
-		if(voxl_i2c_set_device_address(bus, mux_address)){
-			fprintf(stderr, "failed to set i2c slave config on bus %d, address %d\n",
-					bus, mux_address);
-			return -1;
-		}
-
-		// set bitmask for mux channels to open
-		uint8_t bitmask;
-		if(mux_ch>7){
-			bitmask = 0xFF;			// all
-			if(en_debug) printf("setting mux to all enabled\n");
-		}
-		else if(mux_ch<0){
-			bitmask = 0;			// none
-			if(en_debug) printf("setting mux to all off\n");
-		}
-		else{
-			bitmask = 1 << mux_ch;	// just one
-			if(en_debug) printf("setting mux to port %d only\n", mux_ch);
-		}
-
-		if(voxl_i2c_send_byte(bus, bitmask)){
-			fprintf(stderr, "failed to write to i2c multiplexer\n");
-			return -1;
-		}
-	}
-
-	// then put address back to the rangefinder
-	// this could be primary or secondary address
-	if(voxl_i2c_set_device_address(bus, addr)){
-		fprintf(stderr, "failed to set i2c slave config on bus %d, address %d\n",
-				bus, addr);
-		return -1;
-	}
-	return 0;
-}
-
-
-static int _init_all(void)
+// true if anyone is listening to any of our outputs, or could be
+static int _should_sample(void)
 {
-	// if we have a nonmux sensor alongside a mux, set it to the secondary address
-	if(has_nonmux_sensor && n_mux_sensors>0){
-		_set_multiplexer(MUX_NONE, VL53L1X_TOF_DEFAULT_ADDR);
-		if(vl53l1x_swap_to_secondary_address()){
-			return -1;
-		}
-	}
-	else vl53l1x_set_bus_to_default_slave_address();
-
-
-	// init all the sensors
-	for(int i=0;i<n_enabled_sensors;i++){
-
-		// set up non-multiplexed sensor
-		if(enabled_sensors[i].is_on_mux == 0){
-			printf("initializing non-multiplexed tof sensor id %d\n", \
-											enabled_sensors[i].sensor_id);
-			// only turn off mux if needed
-			if(n_mux_sensors>0 && _set_multiplexer(MUX_NONE, VL53L1X_TOF_SECONDARY_ADDR)){
-				fprintf(stderr, "failed to set slave\n");
-				return -1;
-			}
-		}
-		else{
-			printf("initializing multiplexed tof sensor id %d at mux port %d\n", enabled_sensors[i].sensor_id, enabled_sensors[i].i2c_mux_port);
-
-			if(_set_multiplexer(enabled_sensors[i].i2c_mux_port, VL53L1X_TOF_DEFAULT_ADDR)){
-				fprintf(stderr, "failed to set slave\n");
-				return -1;
-			}
-		}
-
-		// finally init the single sensor after much multiplexer logic
-		if(vl53l1x_init(enabled_sensors[i].fov_deg, vl53l1x_timing_budget_ms)){
-			fprintf(stderr, "Error initializing sensor %d\n", i);
-			return -1;
-		}
-	}
-
+	if(en_debug) return 1;
+	if(pipe_server_get_num_clients(PIPE_CH)>0) return 1;
+	if(sample_pipe_num_clients()>0) return 1;
+	if(sensor_pipes_num_clients()>0) return 1;
+	if(point_cloud_num_clients()>0) return 1;
+	if(height_num_clients()>0) return 1;
+	if(predictor_num_clients()>0) return 1;
+	if(range_rate_num_clients()>0) return 1;
+	if(filter_num_clients()>0) return 1;
+	if(frame_num_clients()>0) return 1;
+	if(world_points_num_clients()>0) return 1;
+	// the autopilot needs obstacle data whether or not anything else listens
+	if(en_mavlink_obstacle_distance || uart_mavlink_is_enabled()) return 1;
+	// history needs filling and shared memory readers can't be counted
+	if(history_s>0.0f || en_shm_latest || en_voxel_map) return 1;
 	return 0;
 }
 
 
-static void _start_ranging_all(void)
-{
-	// start the standalone sensor ranging if it exists
-	if(has_nonmux_sensor){
-		if(n_mux_sensors>0) _set_multiplexer(MUX_NONE, VL53L1X_TOF_SECONDARY_ADDR);
-		else vl53l1x_set_bus_to_default_slave_address();
-
-		if(vl53l1x_start_ranging()){
-			fprintf(stderr, "failed to start ranging\n");
-			_quit(-1);
-		}
-	}
-	// start all the multiplexed sensors reading at the same time
-	if(n_mux_sensors>0){
-		_set_multiplexer(MUX_ALL, VL53L1X_TOF_DEFAULT_ADDR);
-		if(vl53l1x_start_ranging()){
-			fprintf(stderr, "failed to start ranging\n");
-			_quit(-1);
-		}
-	}
-	return;
-}
-
-
-static void _clear_interrupt_all(void)
-{
-	if(has_nonmux_sensor){
-		if(n_mux_sensors>0) _set_multiplexer(MUX_NONE, VL53L1X_TOF_SECONDARY_ADDR);
-		else vl53l1x_set_bus_to_default_slave_address();
-		if(vl53l1x_clear_interrupt()){
-			fprintf(stderr, "failed to clear interrupt\n");
-		}
-	}
-	// start all the multiplexed sensors reading at the same time
-	if(n_mux_sensors>0){
-		_set_multiplexer(MUX_ALL, VL53L1X_TOF_DEFAULT_ADDR);
-		if(vl53l1x_clear_interrupt()){
-			fprintf(stderr, "failed to clear interrupt\n");
-		}
-	}
-	return;
-}
-
-
-
-static void _stop_ranging_all(void)
+static void _quit(int ret)
 {
-	// start the standalone sensor ranging if it exists
-	// TODO this should be the secondary address later
-	if(has_nonmux_sensor){
-		if(n_mux_sensors>0) _set_multiplexer(MUX_NONE, VL53L1X_TOF_SECONDARY_ADDR);
-		else vl53l1x_set_bus_to_default_slave_address();
-		if(vl53l1x_stop_ranging()){
-			fprintf(stderr, "WARNING failed to stop ranging\n");
-		}
-	}
-	// start all the multiplexed sensors reading at the same time
-	if(n_mux_sensors>0){
-		_set_multiplexer(MUX_ALL, VL53L1X_TOF_DEFAULT_ADDR);
-		if(vl53l1x_stop_ranging()){
-			fprintf(stderr, "WARNING failed to stop ranging\n");
-		}
-	}
+	rangefinder_close(&ctx);
+	pipeline_stop();
+	frame_stop();
+	predictor_stop();
+	pose_stop();
+	pipe_server_close_all();
+	history_cleanup();
+	shm_latest_cleanup();
+	voxel_map_cleanup();
+	remove_pid_file(PROCESS_NAME);
+	printf("exiting\n");
+	exit(ret);
 	return;
 }
 
 
-
-
 int main(int argc, char* argv[])
 {
 	int i;
@@ -333,6 +232,8 @@ int main(int argc, char* argv[])
 	// read in config file
 	if(read_config_file()) return -1;
 	print_config();
+	if(geometry_init()) return -1;
+	if(consistency_init()) return -1;
 
 	// make sure another instance isn't running
 	// if return value is -3 then a background process is running with
@@ -347,20 +248,18 @@ int main(int argc, char* argv[])
 		return -1;
 	}
 
-	printf("initializing i2c bus %d\n", bus);
-	// don't worry, we will be changing this address later
-	if(voxl_i2c_init(bus, VL53L1X_TOF_DEFAULT_ADDR)){
-		fprintf(stderr, "failed to init bus\n");
+	// set up the sensor library with just the enabled sensors
+	if(rangefinder_ctx_init(&ctx, bus, vl53l1x_timing_budget_ms, \
+										enabled_sensors, n_enabled_sensors)){
 		return -1;
 	}
+	printf("has_nonmux_sensor: %d\n", ctx.has_nonmux_sensor);
+	printf("n_mux_sensors:     %d\n", ctx.n_mux_sensors);
 
-	// let sensors wake up, todo check if this is needed
-	usleep(10000);
 	make_pid_file(PROCESS_NAME);
 
 	// initialize all vl53l1x
-	if(_init_all()) _quit(-1);
-	if(en_debug) printf("finished initializing %d vl53l1x sensors\n", n_enabled_sensors);
+	if(rangefinder_open(&ctx)) _quit(-1);
 
 
 	// create the pipe
@@ -371,37 +270,38 @@ int main(int argc, char* argv[])
 		.server_name = PROCESS_NAME,\
 		.size_bytes  = RANGEFINDER_RECOMMENDED_PIPE_SIZE};
 
-	if(pipe_server_create(PIPE_CH, info, 0)) _quit(-1);
-
-	// pre-fill an array of data structs to send out the pipe
-	rangefinder_data_t data[MAX_SENSORS];
-	for(i=0; i<n_enabled_sensors;i++){
-		data[i].magic_number			= RANGEFINDER_MAGIC_NUMBER;
-		data[i].timestamp_ns			= 0;
-		data[i].sample_id				= 0;
-		data[i].sensor_id				= enabled_sensors[i].sensor_id;
-		data[i].distance_m				= 0.0f;
-		data[i].fov_deg					= enabled_sensors[i].fov_deg;
-		data[i].location_wrt_body[0]	= enabled_sensors[i].location_wrt_body[0];
-		data[i].location_wrt_body[1]	= enabled_sensors[i].location_wrt_body[1];
-		data[i].location_wrt_body[2]	= enabled_sensors[i].location_wrt_body[2];
-		data[i].direction_wrt_body[0]	= enabled_sensors[i].direction_wrt_body[0];
-		data[i].direction_wrt_body[1]	= enabled_sensors[i].direction_wrt_body[1];
-		data[i].direction_wrt_body[2]	= enabled_sensors[i].direction_wrt_body[2];
-		data[i].range_max_m				= enabled_sensors[i].range_max_m;
-		data[i].type					= enabled_sensors[i].type;
-		data[i].reserved				= 0;
+	pipe_server_set_control_cb(PIPE_CH, _control_pipe_cb, NULL);
+	pipe_server_set_available_control_commands(PIPE_CH, \
+					CLIENT_RATE_CONTROL_COMMANDS "," HISTORY_CONTROL_COMMANDS);
+	client_rate_init(PIPE_CH);
+	if(pipe_server_create(PIPE_CH, info, SERVER_FLAG_EN_CONTROL_PIPE)) _quit(-1);
+	if(history_init(PIPE_CH)) _quit(-1);
+	if(sample_pipe_init()) _quit(-1);
+	if(sensor_pipes_init()) _quit(-1);
+	if(shm_latest_init()) _quit(-1);
+	if(point_cloud_init()) _quit(-1);
+	if(height_init()) _quit(-1);
+	if(predictor_init()) _quit(-1);
+	if(range_rate_init()) _quit(-1);
+	if(filter_init()) _quit(-1);
+	if(frame_init()) _quit(-1);
+	if(voxel_map_init()) _quit(-1);
+	if(world_points_init()) _quit(-1);
+
+	// height needs the autopilot attitude even if we send nothing to it
+	int en_mavlink = n_mavlink_sensor_ids>0 || en_mavlink_obstacle_distance || \
+										en_height || en_height_predictor;
+	if(en_mavlink){
+		if(mavlink_start()) _quit(-1);
 	}
 
-	if(id_for_mavlink>=0){
-		mavlink_start();
-	}
+	// everything downstream of the sensors runs through the stage pipeline
+	if(pipeline_init(en_mavlink)) _quit(-1);
 
 
 	// now the sensors should have woken up. Start then ranging right before
 	// we start the read loop.
-	_start_ranging_all();
-	_clear_interrupt_all();
+	if(rangefinder_start(&ctx)) _quit(-1);
 
 
 	// keep sampling until signal handler tells us to stop
@@ -410,90 +310,62 @@ int main(int argc, char* argv[])
 
 	while(main_running){
 
-		// small array to keep the distances in
-		int dist_mm[n_enabled_sensors];
-		int sd_mm[n_enabled_sensors];
-		int64_t read_time_ns; // set after we read the interrupt
-		int had_error = 0;
+		// small array to keep the results in
+		rangefinder_result_t res[RANGEFINDER_MAX_SENSORS];
+		int64_t timestamp_ns;
 
 		// nothing to do if there are no clients and not in debug mode
-		if(pipe_server_get_num_clients(PIPE_CH)<=0 && !en_debug){
+		if(!_should_sample()){
 			usleep(500000);
 			continue;
 		}
 
 
-		// sleep a bit while they range, this usually take a little more time
-		// than the timing budget.
-		usleep((vl53l1x_timing_budget_ms*1000)+8000);
-
-		if(en_debug) printf("---------------------------\n");
-
-		// now start reading the data back in
-		for(i=0;i<n_enabled_sensors;i++){
-
-			// switch i2c bus and multiplexer over to either a multiplexed or non-multiplexed sensor
-			if(enabled_sensors[i].is_on_mux == 0){
-				if(n_mux_sensors>0){
-					had_error |= _set_multiplexer(MUX_NONE, VL53L1X_TOF_SECONDARY_ADDR);
-				}
-				else had_error |= vl53l1x_set_bus_to_default_slave_address();
-			}
-			else{
-				had_error |= _set_multiplexer(	enabled_sensors[i].i2c_mux_port,\
-									VL53L1X_TOF_DEFAULT_ADDR);
-			}
+		// wait for the sensors to finish ranging and read them all in
+		int had_error = rangefinder_sample(&ctx, res, &timestamp_ns);
+		uint32_t sample_id = ctx.sample_id;
 
-			// set output to error values incase there is an issue
-			dist_mm[i] = -1;
-			sd_mm[i]   = -1;
+		// in oversampling mode only publish once a window has been averaged
+		int publish = 1;
+		int64_t publish_ns = timestamp_ns;
+		if(oversample_hz>0.0f){
+			publish = oversample_add(res, n_enabled_sensors, &publish_ns);
+		}
 
-			// only for the first sensor, wait for it to be done ranging
-			if(i==0){
-				if(vl53l1x_wait_for_data()){
-					fprintf(stderr, "WARNING sensor %d failed to report new data\n", i);
-					had_error |= -1;
+		// fill a batch straight into the pipeline arena and hand it off
+		pipeline_batch_t* b = publish ? pipeline_get_batch() : NULL;
+		if(b!=NULL){
+			rangefinder_data_t* data = b->data;
+			rangefinder_sample_ext_t* samples = b->samples;
+
+			for(i=0; i<n_enabled_sensors; i++){
+				data[i].timestamp_ns			= publish_ns;
+				data[i].sample_id				= sample_id;
+				data[i].distance_m				= (float)(res[i].dist_mm)/1000.0f;
+				data[i].uncertainty_m			= (float)(res[i].sd_mm*2)/1000.0f;
+				if(res[i].status != RANGEFINDER_STATUS_VALID) data[i].distance_m = -1;
+
+				rangefinder_sample_t* s = &samples[i].sample;
+				s->timestamp_ns					= publish_ns;
+				s->sample_id					= sample_id;
+				s->distance_mm					= res[i].dist_mm;
+				s->uncertainty_mm				= res[i].sd_mm*2;
+				s->status						= res[i].status;
+				samples[i].peak_signal_mcps		= res[i].peak_signal_mcps;
+				samples[i].ambient_mcps			= res[i].ambient_mcps;
+				samples[i].effective_spads		= res[i].effective_spads;
+				samples[i].range_status			= res[i].range_status;
+				samples[i].signal_quality		= res[i].signal_quality;
+
+				// clip our output at max range since we don't trust the sensor beyond that
+				if(data[i].distance_m>data[i].range_max_m){
+					data[i].distance_m = -1;
+					s->distance_mm				= -1;
+					s->status					= RANGEFINDER_STATUS_OUT_OF_RANGE;
+					samples[i].signal_quality	= 1;
 				}
-				read_time_ns = _apps_time_monotonic_ns();
-				// clear interrupt on first sensor so it's clear next time we start polling
-				had_error |= vl53l1x_clear_interrupt();
 			}
-
-			// read in the data
-			had_error |= vl53l1x_get_distance_mm(&dist_mm[i], &sd_mm[i]);
-		}
-
-		// here is where we used to clear the interrupt on all sensors
-		// now we only do the first one since we only wait for the data ready
-		// flag on the first one. TODO maybe do this one in a while along with a
-		// stop and start ranging call to get them all back in sync
-		//_clear_interrupt_all();
-
-		// assume timestamp of data was from halfway through the reading process
-		int64_t timestamp_ns = read_time_ns - (vl53l1x_timing_budget_ms*500000);
-
-		// keep track of number of samples read
-		static int sample_id = 0;
-		sample_id ++;
-
-		// populate data for pipe and send it out all at once
-		for(i=0; i<n_enabled_sensors; i++){
-			data[i].timestamp_ns			= timestamp_ns;
-			data[i].sample_id				= sample_id;
-			data[i].distance_m				= (float)(dist_mm[i])/1000.0f;
-			data[i].uncertainty_m			= (float)(sd_mm[i]*2)/1000.0f;
-
-			// clip our output at max range since we don't trust the sensor beyond that
-			if(data[i].distance_m>data[i].range_max_m) data[i].distance_m = -1;
-		}
-		pipe_server_write(PIPE_CH, data, sizeof(rangefinder_data_t)*n_enabled_sensors);
-
-
-		// TODO this index is not necessarily true if the downward sensor is in
-		// the middle of a list and a prior id is disabled. So best to kee the downward
-		// sensor with ID=0
-		if(id_for_mavlink>=0){
-			mavlink_publish(data[id_for_mavlink]);
+			pipeline_submit(b);
 		}
 
 		// print distances in debug mode
@@ -501,7 +373,14 @@ int main(int argc, char* argv[])
 			static int64_t last_time_ns = 0;
 			if(last_time_ns==0) last_time_ns = timestamp_ns;
 			double dt_ms = (timestamp_ns-last_time_ns)/1000000.0;
-			printf("dt = %6.1fms\n", dt_ms);
+			int64_t offset_ns;
+			double jitter_ms;
+			if(timesync_get_offset(&offset_ns, &jitter_ms)==0){
+				printf("dt = %6.1fms  ap offset = %0.3fs jitter = %0.2fms\n", \
+						dt_ms, (double)offset_ns/1000000000.0, jitter_ms);
+			}
+			else printf("dt = %6.1fms\n", dt_ms);
+			pipeline_request_stats();
 			last_time_ns = timestamp_ns;
 		}
 
@@ -509,7 +388,6 @@ int main(int argc, char* argv[])
 			err_ctr++;
 			if(err_ctr>3){
 				fprintf(stderr, "Encountered too many errors, quitting\n");
-				_stop_ranging_all();
 				_quit(-1);
 			}
 		}
@@ -517,8 +395,7 @@ int main(int argc, char* argv[])
 	} // end of main read loop
 
 
-	// // close and cleanup
-	// _stop_ranging_all();
+	pipeline_stop();
 	mavlink_stop();
 	printf("exiting cleanly\n");
 	_quit(0);
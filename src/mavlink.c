@@ -33,6 +33,7 @@
 
 
 #include <stdio.h>
+#include <math.h>
 
 #include <c_library_v2/common/mavlink.h>
 #include <modal_pipe_client.h>
@@ -41,10 +42,59 @@
 #include "mavlink.h"
 #include "common.h"
 #include "config_file.h"
+#include "geometry.h"
+#include "timesync.h"
+#include "uart_mavlink.h"
+#include "attitude.h"
 
 // keep track of the autopilot sysid
 static uint8_t current_sysid = 0;
 
+// send a TIMESYNC request this often, the reply echoes our timestamp back
+#define TIMESYNC_PERIOD_NS	1000000000
+static int64_t last_timesync_request_ns = 0;
+static uint32_t attitude_timesync_gen = 0;
+
+#define SIN45_F	0.70710678f
+
+// within about 5 degrees of a standard orientation is close enough to use its enum
+#define ORIENTATION_MATCH_COS	0.996f
+
+// OBSTACLE_DISTANCE has 72 sectors of 5 degrees starting at body-frame forward
+#define N_SECTORS			72
+#define SECTOR_WIDTH_DEG	5
+
+// sectors covered by each horizontal sensor, precomputed at startup
+static int n_horizontal = 0;
+static int horiz_index[MAX_SENSORS];		// index into enabled_sensors
+static int horiz_first_sector[MAX_SENSORS];
+static int horiz_n_sectors[MAX_SENSORS];
+static float horiz_cos_elev[MAX_SENSORS];	// project slant range onto the horizontal plane
+static uint16_t obstacle_max_distance_cm = 0;
+
+// DISTANCE_SENSOR setup for each sensor in mavlink_sensor_ids
+static int n_mav_sensors = 0;
+static int mav_index[MAX_SENSORS];			// index into enabled_sensors
+static uint8_t mav_orientation[MAX_SENSORS];
+static float mav_q[MAX_SENSORS][4];
+
+// directions that have a MAV_SENSOR_ROTATION enum, in FRD body frame
+static const struct {
+	float dir[3];
+	uint8_t orientation;
+} standard_orientations[] = {
+	{{ 1.0f,     0.0f,    0.0f}, MAV_SENSOR_ROTATION_NONE},
+	{{ SIN45_F,  SIN45_F, 0.0f}, MAV_SENSOR_ROTATION_YAW_45},
+	{{ 0.0f,     1.0f,    0.0f}, MAV_SENSOR_ROTATION_YAW_90},
+	{{-SIN45_F,  SIN45_F, 0.0f}, MAV_SENSOR_ROTATION_YAW_135},
+	{{-1.0f,     0.0f,    0.0f}, MAV_SENSOR_ROTATION_YAW_180},
+	{{-SIN45_F, -SIN45_F, 0.0f}, MAV_SENSOR_ROTATION_YAW_225},
+	{{ 0.0f,    -1.0f,    0.0f}, MAV_SENSOR_ROTATION_YAW_270},
+	{{ SIN45_F, -SIN45_F, 0.0f}, MAV_SENSOR_ROTATION_YAW_315},
+	{{ 0.0f,     0.0f,   -1.0f}, MAV_SENSOR_ROTATION_PITCH_90},
+	{{ 0.0f,     0.0f,    1.0f}, MAV_SENSOR_ROTATION_PITCH_270},
+};
+
 
 
 // called whenever we disconnect from the server
@@ -61,9 +111,12 @@ static void _connect_cb(__attribute__((unused)) int ch, __attribute__((unused))
 	return;
 }
 
+
 static void _data_from_autopilot_helper_cb(__attribute__((unused))int ch, char* data, \
 							int bytes, __attribute__((unused)) void* context)
 {
+	int64_t received_ns = time_monotonic_ns();
+
 	// validate that the data makes sense
 	int n_packets;
 	mavlink_message_t* msg_array = pipe_validate_mavlink_message_t(data, bytes, &n_packets);
@@ -82,14 +135,164 @@ static void _data_from_autopilot_helper_cb(__attribute__((unused))int ch, char*
 			current_sysid = msg->sysid;
 			printf("Detected Autopilot Mavlink SYSID %d\n", current_sysid);
 		}
+		if(msg->compid != MAV_COMP_ID_AUTOPILOT1) continue;
+
+		if(msg->msgid == MAVLINK_MSG_ID_TIMESYNC){
+			mavlink_timesync_t t;
+			mavlink_msg_timesync_decode(msg, &t);
+			// only replies to our own requests, others may be syncing too
+			int64_t sent_ns = __atomic_load_n(&last_timesync_request_ns, __ATOMIC_ACQUIRE);
+			if(t.tc1 != 0 && t.ts1 == sent_ns){
+				timesync_add_timesync(t.tc1, t.ts1, received_ns);
+			}
+		}
+		else if(msg->msgid == MAVLINK_MSG_ID_SYSTEM_TIME){
+			mavlink_system_time_t t;
+			mavlink_msg_system_time_decode(msg, &t);
+			timesync_add_system_time(t.time_boot_ms, received_ns);
+		}
+		else if(msg->msgid == MAVLINK_MSG_ID_ATTITUDE){
+			mavlink_attitude_t a;
+			mavlink_msg_attitude_decode(msg, &a);
+			// the old entries were stamped with an offset that no longer
+			// holds, and newer ones may now land before them
+			uint32_t gen = timesync_get_generation();
+			if(gen != attitude_timesync_gen){
+				attitude_reset();
+				attitude_timesync_gen = gen;
+			}
+			// use the autopilot's own timestamp once synced, arrival time until then
+			int64_t t_ns;
+			if(timesync_to_monotonic_ns((int64_t)a.time_boot_ms*1000000, &t_ns)){
+				t_ns = received_ns;
+			}
+			attitude_add(t_ns, a.roll, a.pitch, a.yaw);
+		}
+	}
+
+	return;
+}
+
+
+// work out which sectors each sensor covers. Only sensors whose fov cone
+// crosses the horizontal plane are used.
+static void _init_obstacle_sectors(void)
+{
+	n_horizontal = 0;
+	obstacle_max_distance_cm = 0;
+	if(!en_mavlink_obstacle_distance) return;
+
+	for(int i=0; i<geom.n; i++){
+		if(!geom.has_dir[i]) continue;
+
+		// body frame is FRD so positive z is down
+		float elev = asinf(-geom.dir[2][i]);
+		if(fabsf(elev) > geom.half_fov_rad[i]) continue;
+
+		float yaw_deg = atan2f(geom.dir[1][i], geom.dir[0][i]) * 180.0f / (float)M_PI;
+		float half_deg = geom.half_fov_rad[i] * 180.0f / (float)M_PI;
+
+		// every sector whose center falls inside the fov, at least one
+		int first = (int)ceilf((yaw_deg-half_deg)/SECTOR_WIDTH_DEG);
+		int last  = (int)floorf((yaw_deg+half_deg)/SECTOR_WIDTH_DEG);
+		if(last<first){
+			first = (int)lroundf(yaw_deg/SECTOR_WIDTH_DEG);
+			last = first;
+		}
+
+		int h = n_horizontal;
+		horiz_index[h]			= i;
+		horiz_first_sector[h]	= ((first % N_SECTORS) + N_SECTORS) % N_SECTORS;
+		horiz_n_sectors[h]		= last-first+1;
+		horiz_cos_elev[h]		= cosf(elev);
+		n_horizontal++;
+
+		uint16_t max_cm = enabled_sensors[i].range_max_m*100;
+		if(max_cm > obstacle_max_distance_cm) obstacle_max_distance_cm = max_cm;
+
+		printf("sensor id %d covers obstacle sectors %d-%d\n", enabled_sensors[i].sensor_id, \
+				horiz_first_sector[h], (horiz_first_sector[h]+horiz_n_sectors[h]-1) % N_SECTORS);
 	}
 
+	if(n_horizontal==0){
+		fprintf(stderr, "WARNING no horizontal sensors found for OBSTACLE_DISTANCE\n");
+	}
+	return;
+}
+
+
+// pick the MAV_SENSOR_ROTATION closest to a direction, or CUSTOM if none are
+// close. The quaternion is always filled in as the shortest rotation from
+// body-frame forward to the direction.
+static uint8_t _orientation_from_dir(const float d[3], float q[4])
+{
+	// cross product of x axis and d gives the rotation axis
+	q[0] = 1.0f + d[0];
+	q[1] = 0.0f;
+	q[2] = -d[2];
+	q[3] = d[1];
+	float norm = sqrtf(q[0]*q[0] + q[2]*q[2] + q[3]*q[3]);
+	if(norm < 1e-6f){
+		// facing backwards, yaw 180
+		q[0] = 0.0f; q[1] = 0.0f; q[2] = 0.0f; q[3] = 1.0f;
+	}
+	else{
+		for(int j=0; j<4; j++) q[j] /= norm;
+	}
+
+	int n = sizeof(standard_orientations)/sizeof(standard_orientations[0]);
+	for(int k=0; k<n; k++){
+		const float* s = standard_orientations[k].dir;
+		if(d[0]*s[0] + d[1]*s[1] + d[2]*s[2] > ORIENTATION_MATCH_COS){
+			return standard_orientations[k].orientation;
+		}
+	}
+	return MAV_SENSOR_ROTATION_CUSTOM;
+}
+
+
+// look up each requested sensor_id and work out its orientation once
+static void _init_distance_sensors(void)
+{
+	n_mav_sensors = 0;
+
+	for(int k=0; k<n_mavlink_sensor_ids; k++){
+		int i;
+		for(i=0; i<n_enabled_sensors; i++){
+			if(enabled_sensors[i].sensor_id == mavlink_sensor_ids[k]) break;
+		}
+		if(i==n_enabled_sensors){
+			fprintf(stderr, "WARNING sensor id %d for mavlink is not an enabled sensor\n", mavlink_sensor_ids[k]);
+			continue;
+		}
+
+		int m = n_mav_sensors;
+		mav_index[m] = i;
+		if(geom.has_dir[i]){
+			float d[3] = {geom.dir[0][i], geom.dir[1][i], geom.dir[2][i]};
+			mav_orientation[m] = _orientation_from_dir(d, mav_q[m]);
+		}
+		else{
+			// keep the old assumption for sensors with no direction configured
+			// and send an all-zero quaternion which MAVLink reads as invalid
+			mav_orientation[m] = MAV_SENSOR_ROTATION_PITCH_270;
+			for(int j=0; j<4; j++) mav_q[m][j] = 0.0f;
+		}
+		n_mav_sensors++;
+
+		printf("sending sensor id %d to mavlink with orientation %d\n", \
+						mavlink_sensor_ids[k], mav_orientation[m]);
+	}
 	return;
 }
 
 
 int mavlink_start(void)
 {
+	_init_distance_sensors();
+	_init_obstacle_sectors();
+	if(uart_mavlink_init()) return -1;
+
 	pipe_client_set_connect_cb(MAV_PIPE_CH, _connect_cb, NULL);
 	pipe_client_set_disconnect_cb(MAV_PIPE_CH, _disconnect_cb, NULL);
 	pipe_client_set_simple_helper_cb(MAV_PIPE_CH, _data_from_autopilot_helper_cb, NULL);
@@ -103,52 +306,153 @@ int mavlink_start(void)
 int mavlink_stop(void)
 {
 	pipe_client_close(MAV_PIPE_CH);
+	uart_mavlink_close();
+	timesync_reset();
 	return 0;
 }
 
-// publish a single reading as a DOWNWARD distance sensor
-int mavlink_publish(rangefinder_data_t d) // This looks good -Peter L
+// pack one DISTANCE_SENSOR message
+static void _pack_distance_sensor(int m, rangefinder_sample_ext_t* s, \
+							int64_t ap_ns, mavlink_message_t* msg)
 {
-	if(!pipe_client_is_connected(MAV_PIPE_CH)){
-		return 0;
-	}
+	int i = mav_index[m];
+	rangefinder_sample_t* d = &s[i].sample;
 
-	uint32_t time_boot_ms = 0; // PX4 ignores this right now
+	uint32_t time_boot_ms = ap_ns/1000000; // 0 until we sync with the autopilot
 	uint16_t min_distance = 0;
-	uint16_t max_distance = d.range_max_m*100;
-	uint16_t current_distance = d.distance_m*100;
+	uint16_t max_distance = enabled_sensors[i].range_max_m*100;
+	uint16_t current_distance = d->distance_mm/10;
 	uint8_t type = MAV_DISTANCE_SENSOR_INFRARED;
-	uint8_t id = 0;
-	uint8_t orientation = MAV_SENSOR_ROTATION_PITCH_270;
+	uint8_t id = enabled_sensors[i].sensor_id;
 	uint8_t covariance = UINT8_MAX;
-	float horizontal_fov = d.fov_deg * 3.14159f / 180.0f; // to radians
+	float horizontal_fov = enabled_sensors[i].fov_deg * 3.14159f / 180.0f; // to radians
 	float vertical_fov = horizontal_fov;
-	float quaternion[4] = {NAN, NAN, NAN, NAN};
-	uint8_t signal_quality = 100;
+	uint8_t signal_quality = s[i].signal_quality;
 
-	if(d.distance_m<0){
-		signal_quality = -1; // indicate invalid signal
+	if(d->status != RANGEFINDER_STATUS_VALID){
+		current_distance = UINT16_MAX;
+	}
+	else if(d->uncertainty_mm >= 0){
+		// uncertainty is 2 sigma in mm, covariance is variance in cm^2
+		float sigma_cm = (float)d->uncertainty_mm / 20.0f;
+		float var = ceilf(sigma_cm*sigma_cm);
+		covariance = var < (float)(UINT8_MAX-1) ? (uint8_t)var : UINT8_MAX-1;
 	}
 
-	mavlink_message_t msg;
 	mavlink_msg_distance_sensor_pack(current_sysid, \
 									MAV_COMP_ID_VISUAL_INERTIAL_ODOMETRY, \
-									&msg, \
+									msg, \
 									time_boot_ms, \
 									min_distance, \
 									max_distance, \
 									current_distance, \
 									type, \
 									id, \
-									orientation, \
+									mav_orientation[m], \
 									covariance, \
 									horizontal_fov, \
 									vertical_fov, \
-									quaternion, \
+									mav_q[m], \
 									signal_quality);
+	return;
+}
 
-	pipe_client_send_control_cmd_bytes(MAV_PIPE_CH, &msg, sizeof(mavlink_message_t));
-	return 0;
+
+// pack the nearest reading in every sector around the vehicle
+static void _pack_obstacle_distance(rangefinder_sample_ext_t* s, int64_t ap_ns, \
+												mavlink_message_t* msg)
+{
+	// UINT16_MAX means unknown, max_distance+1 means nothing in range
+	uint16_t distances[N_SECTORS];
+	for(int i=0; i<N_SECTORS; i++) distances[i] = UINT16_MAX;
+
+	for(int h=0; h<n_horizontal; h++){
+		rangefinder_sample_t* d = &s[horiz_index[h]].sample;
+
+		uint16_t cm;
+		if(d->status == RANGEFINDER_STATUS_VALID){
+			cm = (uint16_t)((float)d->distance_mm * 0.1f * horiz_cos_elev[h]);
+		}
+		else if(d->status == RANGEFINDER_STATUS_OUT_OF_RANGE){
+			cm = obstacle_max_distance_cm + 1;
+		}
+		else continue;
+
+		int sector = horiz_first_sector[h];
+		for(int k=0; k<horiz_n_sectors[h]; k++){
+			if(cm < distances[sector]) distances[sector] = cm;
+			sector++;
+			if(sector>=N_SECTORS) sector = 0;
+		}
+	}
+
+	uint64_t time_usec = ap_ns/1000; // 0 until we sync with the autopilot
+	mavlink_msg_obstacle_distance_pack(current_sysid, \
+									MAV_COMP_ID_VISUAL_INERTIAL_ODOMETRY, \
+									msg, \
+									time_usec, \
+									MAV_DISTANCE_SENSOR_INFRARED, \
+									distances, \
+									SECTOR_WIDTH_DEG, \
+									0, \
+									obstacle_max_distance_cm, \
+									(float)SECTOR_WIDTH_DEG, \
+									0.0f, \
+									MAV_FRAME_BODY_FRD);
+	return;
 }
 
 
+int mavlink_publish(rangefinder_sample_ext_t* s, __attribute__((unused)) int n)
+{
+	int ret = 0;
+	int pipe_connected = pipe_client_is_connected(MAV_PIPE_CH);
+	int en_uart = uart_mavlink_is_enabled();
+
+	if(!pipe_connected && !en_uart){
+		return 0;
+	}
+
+	// pack everything for this sample then send it in one write
+	mavlink_message_t msgs[MAX_SENSORS+2];
+	int n_msgs = 0;
+
+	// stamp with when the sample was measured in autopilot time
+	int64_t ap_ns;
+	if(timesync_to_autopilot_ns(s[0].sample.timestamp_ns, &ap_ns) || ap_ns<0){
+		ap_ns = 0;
+	}
+
+	for(int m=0; m<n_mav_sensors; m++){
+		_pack_distance_sensor(m, s, ap_ns, &msgs[n_msgs++]);
+	}
+
+	// DISTANCE_SENSOR goes straight out the uart when configured, everything
+	// else still goes through voxl-mavlink-server
+	if(en_uart && n_msgs>0){
+		ret |= uart_mavlink_write(msgs, n_msgs, s[0].sample.timestamp_ns);
+		n_msgs = 0;
+	}
+	if(!pipe_connected) return ret;
+
+	if(n_horizontal>0){
+		_pack_obstacle_distance(s, ap_ns, &msgs[n_msgs++]);
+	}
+
+	// piggyback a TIMESYNC request on the same write
+	int64_t now_ns = time_monotonic_ns();
+	if(now_ns - last_timesync_request_ns > TIMESYNC_PERIOD_NS){
+		__atomic_store_n(&last_timesync_request_ns, now_ns, __ATOMIC_RELEASE);
+		mavlink_msg_timesync_pack(current_sysid, \
+								MAV_COMP_ID_VISUAL_INERTIAL_ODOMETRY, \
+								&msgs[n_msgs++], \
+								0, \
+								now_ns, \
+								current_sysid, \
+								MAV_COMP_ID_AUTOPILOT1);
+	}
+
+	if(n_msgs==0) return ret;
+	ret |= pipe_client_send_control_cmd_bytes(MAV_PIPE_CH, msgs, sizeof(mavlink_message_t)*n_msgs);
+	return ret;
+}
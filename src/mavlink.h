@@ -39,8 +39,9 @@
 int mavlink_start(void);
 int mavlink_stop(void);
 
-// publish a single reading as a DOWNWARD distance sensor
-int mavlink_publish(rangefinder_data_t d);
+// publish the sensors in mavlink_sensor_ids as DISTANCE_SENSOR and the
+// horizontal sensors as one OBSTACLE_DISTANCE, all in a single write
+int mavlink_publish(rangefinder_sample_ext_t* s, int n);
 
 
 
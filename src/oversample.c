@@ -0,0 +1,133 @@
+/*******************************************************************************
+ * Copyright 2023 ModalAI Inc.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * 4. The Software is used solely in conjunction with devices provided by
+ *    ModalAI Inc.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ ******************************************************************************/
+
+
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+#include <voxl_rangefinder.h>
+
+#include "oversample.h"
+#include "common.h"
+#include "config_file.h"
+
+// vl53l1x sigma can read 0 on a strong target, don't let one reading take
+// all the weight
+#define MIN_SD_MM		1.0
+
+
+typedef struct window_t{
+	int n;
+	double w_sum;			///< sum of 1/sd^2
+	double dist_sum;		///< sum of w*dist
+	double time_sum;		///< sum of w*t relative to the window start
+	double peak_sum;
+	double ambient_sum;
+	double quality_sum;
+	double spads_sum;
+	rangefinder_result_t last;	///< last reading, valid or not, to report when n==0
+} window_t;
+
+
+static int64_t window_start_ns = 0;
+static window_t win[MAX_SENSORS];
+
+
+static void _reset(int64_t t_ns)
+{
+	window_start_ns = t_ns;
+	memset(win, 0, sizeof(win));
+}
+
+
+int oversample_add(rangefinder_result_t* res, int n, int64_t* t_ns)
+{
+	int64_t t = *t_ns;
+	int64_t period_ns = (int64_t)(1000000000.0/(double)oversample_hz);
+
+	if(window_start_ns==0) _reset(t);
+
+	for(int i=0; i<n; i++){
+		window_t* w = &win[i];
+		rangefinder_result_t* r = &res[i];
+		w->last = *r;
+
+		// invalid readings and anything past range_max_m never enter the average
+		if(r->status!=RANGEFINDER_STATUS_VALID) continue;
+		if(r->dist_mm > (int)(enabled_sensors[i].range_max_m*1000.0f)) continue;
+
+		double sd = r->sd_mm>MIN_SD_MM ? r->sd_mm : MIN_SD_MM;
+		double wt = 1.0/(sd*sd);
+		w->n++;
+		w->w_sum		+= wt;
+		w->dist_sum		+= wt*r->dist_mm;
+		w->time_sum		+= wt*(double)(t-window_start_ns);
+		w->peak_sum		+= (double)r->peak_signal_mcps;
+		w->ambient_sum	+= (double)r->ambient_mcps;
+		w->quality_sum	+= r->signal_quality;
+		w->spads_sum	+= r->effective_spads;
+	}
+
+	if(t-window_start_ns < period_ns) return 0;
+
+	// window done, swap the averages in
+	int64_t t_out = t;
+	double w_total = 0.0;
+	double t_total = 0.0;
+	for(int i=0; i<n; i++){
+		window_t* w = &win[i];
+		res[i] = w->last;
+		if(w->n==0) continue;
+
+		res[i].dist_mm			= (int)lround(w->dist_sum/w->w_sum);
+		// independent readings combine to 1/sqrt(sum of 1/sd^2)
+		res[i].sd_mm			= (int)ceil(1.0/sqrt(w->w_sum));
+		res[i].status			= RANGEFINDER_STATUS_VALID;
+		res[i].peak_signal_mcps	= (float)(w->peak_sum/w->n);
+		res[i].ambient_mcps		= (float)(w->ambient_sum/w->n);
+		res[i].signal_quality	= (uint8_t)lround(w->quality_sum/w->n);
+		res[i].effective_spads	= (uint16_t)lround(w->spads_sum/w->n);
+		w_total += w->w_sum;
+		t_total += w->time_sum;
+	}
+
+	// all sensors share one timestamp, use the weighted center of the window
+	if(w_total>0.0) t_out = window_start_ns + (int64_t)(t_total/w_total);
+	*t_ns = t_out;
+
+	// step the window forward but don't let it fall behind if we stalled
+	int64_t next = window_start_ns + period_ns;
+	if(t-next > period_ns) next = t;
+	_reset(next);
+	return 1;
+}
@@ -0,0 +1,322 @@
+/*******************************************************************************
+ * Copyright 2023 ModalAI Inc.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * 4. The Software is used solely in conjunction with devices provided by
+ *    ModalAI Inc.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ ******************************************************************************/
+
+
+#include <stdio.h>
+#include <string.h>
+#include <pthread.h>
+#include <voxl_rangefinder_interface.h>
+
+#include "pipeline.h"
+#include "common.h"
+#include "config_file.h"
+#include "client_rate.h"
+#include "history.h"
+#include "sample_pipe.h"
+#include "shm_latest.h"
+#include "sensor_pipes.h"
+#include "filter.h"
+#include "point_cloud.h"
+#include "height.h"
+#include "range_rate.h"
+#include "mavlink.h"
+#include "consistency.h"
+#include "frame.h"
+#include "voxel_map.h"
+#include "world_points.h"
+#include "uart_mavlink.h"
+
+// batches in flight between the sampling and worker threads, more than a
+// couple means the worker can't keep up anyway
+#define N_BATCHES		4
+
+
+typedef struct stage_t{
+	const char* name;
+	int (*run)(pipeline_batch_t* b);
+	int enabled;
+	// cost since the last stats print, only touched by the thread running
+	// the stages so they need no lock
+	uint64_t n;
+	int64_t sum_ns;
+	int64_t max_ns;
+} stage_t;
+
+
+// stages only ever see pointers into the arena, nothing gets copied
+static pipeline_batch_t arena[N_BATCHES];
+
+// batches [tail, head) are queued for the worker
+static unsigned int head = 0;
+static unsigned int tail = 0;
+static uint64_t n_dropped = 0;
+static int stats_requested = 0;
+
+static int en_thread = 0;
+static int running = 0;
+static pthread_t thread;
+static pthread_mutex_t mtx = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t cond = PTHREAD_COND_INITIALIZER;
+
+
+static int _run_consistency(pipeline_batch_t* b)	{ return consistency_check(b->data, b->samples, b->n); }
+static int _run_client_rate(pipeline_batch_t* b)	{ return client_rate_publish(b->data, b->n); }
+static int _run_history(pipeline_batch_t* b)		{ return history_add(b->data, b->n); }
+static int _run_sample_pipe(pipeline_batch_t* b)	{ return sample_pipe_publish(b->samples, b->n); }
+static int _run_shm_latest(pipeline_batch_t* b)		{ return shm_latest_publish(b->samples, b->n); }
+static int _run_sensor_pipes(pipeline_batch_t* b)	{ return sensor_pipes_publish(b->data, b->n); }
+static int _run_filter(pipeline_batch_t* b)			{ return filter_publish(b->data, b->n); }
+static int _run_point_cloud(pipeline_batch_t* b)	{ return point_cloud_publish(b->samples, b->n); }
+static int _run_height(pipeline_batch_t* b)			{ return height_publish(b->samples, b->n); }
+static int _run_range_rate(pipeline_batch_t* b)		{ return range_rate_publish(b->samples, b->n); }
+static int _run_mavlink(pipeline_batch_t* b)		{ return mavlink_publish(b->samples, b->n); }
+static int _run_frame(pipeline_batch_t* b)			{ return frame_update(b->samples, b->n); }
+static int _run_voxel_map(pipeline_batch_t* b)		{ return voxel_map_update(b->samples, b->n); }
+static int _run_world_points(pipeline_batch_t* b)	{ return world_points_publish(b->samples, b->n); }
+
+
+// in the order they run, consistency first since it edits the batch in place,
+// history before rate so queued backfills reach clients ahead of this cycle,
+// and height before mavlink so the predictor is fed first
+static stage_t stages[] = {
+	{"consistency",	_run_consistency,	0, 0, 0, 0},
+	{"history",		_run_history,		0, 0, 0, 0},
+	{"rate",		_run_client_rate,	0, 0, 0, 0},
+	{"samples",		_run_sample_pipe,	0, 0, 0, 0},
+	{"shm",			_run_shm_latest,	0, 0, 0, 0},
+	{"sensors",		_run_sensor_pipes,	0, 0, 0, 0},
+	{"filter",		_run_filter,		0, 0, 0, 0},
+	{"cloud",		_run_point_cloud,	0, 0, 0, 0},
+	{"height",		_run_height,		0, 0, 0, 0},
+	{"rate_ttc",	_run_range_rate,	0, 0, 0, 0},
+	{"mavlink",		_run_mavlink,		0, 0, 0, 0},
+	{"frame",		_run_frame,			0, 0, 0, 0},
+	{"voxels",		_run_voxel_map,		0, 0, 0, 0},
+	{"world",		_run_world_points,	0, 0, 0, 0},
+};
+#define N_STAGES ((int)(sizeof(stages)/sizeof(stages[0])))
+
+
+static void _set_enabled(const char* name, int en)
+{
+	for(int i=0; i<N_STAGES; i++){
+		if(strcmp(stages[i].name, name)==0) stages[i].enabled = en;
+	}
+}
+
+
+// geometry never changes so fill it into every batch once
+static void _prefill(pipeline_batch_t* b)
+{
+	memset(b, 0, sizeof(pipeline_batch_t));
+	b->n = n_enabled_sensors;
+
+	for(int i=0; i<n_enabled_sensors; i++){
+		rangefinder_data_t* d = &b->data[i];
+		d->magic_number				= RANGEFINDER_MAGIC_NUMBER;
+		d->sensor_id				= enabled_sensors[i].sensor_id;
+		d->fov_deg					= enabled_sensors[i].fov_deg;
+		d->location_wrt_body[0]		= enabled_sensors[i].location_wrt_body[0];
+		d->location_wrt_body[1]		= enabled_sensors[i].location_wrt_body[1];
+		d->location_wrt_body[2]		= enabled_sensors[i].location_wrt_body[2];
+		d->direction_wrt_body[0]	= enabled_sensors[i].direction_wrt_body[0];
+		d->direction_wrt_body[1]	= enabled_sensors[i].direction_wrt_body[1];
+		d->direction_wrt_body[2]	= enabled_sensors[i].direction_wrt_body[2];
+		d->range_max_m				= enabled_sensors[i].range_max_m;
+		d->type						= enabled_sensors[i].type;
+
+		// geometry for the compact samples goes in the pipe info instead
+		rangefinder_sample_ext_t* s = &b->samples[i];
+		s->sample.magic_number		= RANGEFINDER_SAMPLE_MAGIC_NUMBER;
+		s->sample.distance_mm		= -1;
+		s->sample.uncertainty_mm	= -1;
+		s->sample.status			= RANGEFINDER_STATUS_NO_DATA;
+		s->sample.sensor_index		= i;
+		s->range_status				= 255;
+	}
+}
+
+
+// runs on the same thread as the stages so it can read and reset their
+// counters, and those the stage modules keep, without racing them
+static void _print_stats(void)
+{
+	printf("stage avg/max us:");
+	for(int i=0; i<N_STAGES; i++){
+		stage_t* s = &stages[i];
+		if(!s->enabled || s->n==0) continue;
+		printf(" %s %0.0f/%0.0f", s->name, (double)s->sum_ns/s->n/1000.0, (double)s->max_ns/1000.0);
+		s->n = 0;
+		s->sum_ns = 0;
+		s->max_ns = 0;
+	}
+	if(en_thread){
+		pthread_mutex_lock(&mtx);
+		unsigned int queued = head-tail;
+		uint64_t dropped = n_dropped;
+		n_dropped = 0;
+		pthread_mutex_unlock(&mtx);
+		printf(" queued %u dropped %llu", queued, (unsigned long long)dropped);
+	}
+	printf("\n");
+
+	uart_mavlink_print_stats();
+	consistency_print_stats();
+	voxel_map_print_stats();
+	return;
+}
+
+
+static void _run_stages(pipeline_batch_t* b)
+{
+	for(int i=0; i<N_STAGES; i++){
+		stage_t* s = &stages[i];
+		if(!s->enabled) continue;
+
+		int64_t t0 = time_monotonic_ns();
+		s->run(b);
+		int64_t dt = time_monotonic_ns() - t0;
+
+		s->n++;
+		s->sum_ns += dt;
+		if(dt > s->max_ns) s->max_ns = dt;
+	}
+
+	if(__atomic_exchange_n(&stats_requested, 0, __ATOMIC_ACQ_REL)) _print_stats();
+	return;
+}
+
+
+static void* _worker_func(__attribute__((unused)) void* arg)
+{
+	pthread_mutex_lock(&mtx);
+	while(1){
+		while(running && head==tail) pthread_cond_wait(&cond, &mtx);
+		// drain the queue before honoring a stop
+		if(head==tail) break;
+
+		pipeline_batch_t* b = &arena[tail%N_BATCHES];
+		pthread_mutex_unlock(&mtx);
+		_run_stages(b);
+		pthread_mutex_lock(&mtx);
+		tail++;
+	}
+	pthread_mutex_unlock(&mtx);
+	return NULL;
+}
+
+
+int pipeline_init(int en_mavlink)
+{
+	for(int i=0; i<N_BATCHES; i++) _prefill(&arena[i]);
+
+	int en_filter = 0;
+	for(int i=0; i<n_enabled_sensors; i++){
+		if(enabled_filters[i].type!=FILTER_NONE) en_filter = 1;
+	}
+
+	_set_enabled("consistency",	en_consistency_check);
+	_set_enabled("rate",		1);
+	_set_enabled("history",		history_s>0.0f);
+	_set_enabled("samples",		1);
+	_set_enabled("shm",			en_shm_latest);
+	_set_enabled("sensors",		en_per_sensor_pipes);
+	_set_enabled("filter",		en_filter);
+	_set_enabled("cloud",		en_point_cloud);
+	_set_enabled("height",		en_height || en_height_predictor);
+	_set_enabled("rate_ttc",	en_range_rate);
+	_set_enabled("mavlink",		en_mavlink);
+	_set_enabled("frame",		frame_rate_hz>0.0f);
+	_set_enabled("voxels",		en_voxel_map);
+	_set_enabled("world",		en_world_points);
+
+	en_thread = en_pipeline_thread;
+	if(!en_thread) return 0;
+
+	running = 1;
+	if(pthread_create(&thread, NULL, _worker_func, NULL)){
+		fprintf(stderr, "ERROR failed to start pipeline thread\n");
+		running = 0;
+		en_thread = 0;
+		return -1;
+	}
+	return 0;
+}
+
+
+pipeline_batch_t* pipeline_get_batch(void)
+{
+	if(!en_thread) return &arena[0];
+
+	pipeline_batch_t* b = NULL;
+	pthread_mutex_lock(&mtx);
+	if(head-tail < N_BATCHES) b = &arena[head%N_BATCHES];
+	else n_dropped++;
+	pthread_mutex_unlock(&mtx);
+	return b;
+}
+
+
+int pipeline_submit(pipeline_batch_t* b)
+{
+	if(!en_thread){
+		_run_stages(b);
+		return 0;
+	}
+
+	pthread_mutex_lock(&mtx);
+	head++;
+	pthread_cond_signal(&cond);
+	pthread_mutex_unlock(&mtx);
+	return 0;
+}
+
+
+void pipeline_request_stats(void)
+{
+	__atomic_store_n(&stats_requested, 1, __ATOMIC_RELEASE);
+	return;
+}
+
+
+void pipeline_stop(void)
+{
+	if(!running) return;
+
+	pthread_mutex_lock(&mtx);
+	running = 0;
+	pthread_cond_signal(&cond);
+	pthread_mutex_unlock(&mtx);
+	pthread_join(thread, NULL);
+	return;
+}
@@ -0,0 +1,81 @@
+/*******************************************************************************
+ * Copyright 2023 ModalAI Inc.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * 4. The Software is used solely in conjunction with devices provided by
+ *    ModalAI Inc.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ ******************************************************************************/
+
+
+#ifndef PIPELINE_H
+#define PIPELINE_H
+
+#include <voxl_rangefinder_interface.h>
+#include "common.h"
+
+// one cycle worth of output from every sensor, lives in the pipeline arena
+typedef struct pipeline_batch_t{
+	int n;
+	rangefinder_data_t data[MAX_SENSORS];
+	rangefinder_sample_ext_t samples[MAX_SENSORS];
+} pipeline_batch_t;
+
+
+/**
+ * @brief      set up the batch arena and stage table, call after all the
+ *             output modules have been initialized. Starts the worker
+ *             thread if en_pipeline_thread is set.
+ *
+ * @param[in]  en_mavlink  enable the mavlink stage
+ *
+ * @return     0 on success, -1 on failure
+ */
+int pipeline_init(int en_mavlink);
+
+/**
+ * @brief      get the next free batch for the sampling thread to fill in.
+ *             Sensor geometry is already filled in.
+ *
+ * @return     pointer into the arena, or NULL if the worker thread is so far
+ *             behind that every batch is still queued.
+ */
+pipeline_batch_t* pipeline_get_batch(void);
+
+// hand a filled batch to the stages, runs them inline without the worker
+int pipeline_submit(pipeline_batch_t* b);
+
+// print and reset the per-stage cost, along with the uart, consistency and
+// voxel map stats. This only sets a flag, the printing is done after the
+// next batch by whichever thread runs the stages since they own the counters
+void pipeline_request_stats(void);
+
+// finish whatever is queued and stop the worker thread
+void pipeline_stop(void);
+
+
+#endif // end #define PIPELINE_H
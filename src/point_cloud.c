@@ -0,0 +1,131 @@
+/*******************************************************************************
+ * Copyright 2023 ModalAI Inc.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * 4. The Software is used solely in conjunction with devices provided by
+ *    ModalAI Inc.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ ******************************************************************************/
+
+
+#include <stdio.h>
+#include <string.h>
+#include <modal_pipe_server.h>
+#include <voxl_rangefinder_interface.h>
+
+#include "point_cloud.h"
+#include "geometry.h"
+#include "common.h"
+#include "config_file.h"
+
+
+#define MAX_POINTS	(MAX_SENSORS*(1+GEOMETRY_N_EDGES))
+
+static int ch = -1;
+
+
+int point_cloud_init(void)
+{
+	if(!en_point_cloud) return 0;
+
+	ch = pipe_server_get_next_available_channel();
+
+	pipe_info_t info = { \
+		.name        = RANGEFINDER_POINT_CLOUD_PIPE_NAME,\
+		.location    = RANGEFINDER_POINT_CLOUD_PIPE_LOCATION ,\
+		.type        = "point_cloud",\
+		.server_name = PROCESS_NAME,\
+		.size_bytes  = RANGEFINDER_RECOMMENDED_PIPE_SIZE};
+
+	return pipe_server_create(ch, info, 0);
+}
+
+
+int point_cloud_num_clients(void)
+{
+	if(ch<0) return 0;
+	return pipe_server_get_num_clients(ch);
+}
+
+
+// project range d along unit vectors v from the sensor locations for all
+// sensors at once, kept branch-free so it vectorizes
+static void _project(const float* restrict d, float v[3][MAX_SENSORS],
+					float out[3][MAX_SENSORS], int n)
+{
+	for(int j=0; j<3; j++){
+		const float* restrict loc = geom.loc[j];
+		const float* restrict dir = v[j];
+		float* restrict o = out[j];
+		for(int i=0; i<n; i++){
+			o[i] = loc[i] + d[i]*dir[i];
+		}
+	}
+	return;
+}
+
+
+int point_cloud_publish(rangefinder_sample_ext_t* s, int n)
+{
+	int i, j, k;
+
+	if(ch<0 || pipe_server_get_num_clients(ch)<=0) return 0;
+
+	float d[MAX_SENSORS];
+	int valid[MAX_SENSORS];
+	for(i=0; i<n; i++){
+		valid[i] = s[i].sample.status==RANGEFINDER_STATUS_VALID && geom.has_dir[i];
+		d[i] = (float)s[i].sample.distance_mm * 0.001f;
+	}
+
+	// center points, then optionally the cone edges
+	int n_sets = en_point_cloud_cone_edges ? (1+GEOMETRY_N_EDGES) : 1;
+	float p[1+GEOMETRY_N_EDGES][3][MAX_SENSORS];
+	_project(d, geom.dir, p[0], n);
+	for(k=1; k<n_sets; k++) _project(d, geom.edge[k-1], p[k], n);
+
+	// pack valid readings into interleaved XYZ
+	float points[MAX_POINTS][3];
+	int n_points = 0;
+	for(i=0; i<n; i++){
+		if(!valid[i]) continue;
+		for(k=0; k<n_sets; k++){
+			for(j=0; j<3; j++) points[n_points][j] = p[k][j][i];
+			n_points++;
+		}
+	}
+
+	point_cloud_metadata_t meta;
+	memset(&meta, 0, sizeof(meta));
+	meta.magic_number	= POINT_CLOUD_MAGIC_NUMBER;
+	meta.timestamp_ns	= s[0].sample.timestamp_ns;
+	meta.n_points		= n_points;
+	meta.format			= POINT_CLOUD_FORMAT_FLOAT_XYZ;
+	strncpy(meta.server_name, PROCESS_NAME, sizeof(meta.server_name)-1);
+
+	return pipe_server_write_point_cloud(ch, meta, points);
+}
@@ -0,0 +1,237 @@
+/*******************************************************************************
+ * Copyright 2023 ModalAI Inc.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * 4. The Software is used solely in conjunction with devices provided by
+ *    ModalAI Inc.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ ******************************************************************************/
+
+
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+#include <modal_pipe_client.h>
+#include <modal_pipe_interfaces.h>
+
+#include "pose.h"
+#include "common.h"
+#include "config_file.h"
+
+
+typedef struct pose_entry_t{
+	int64_t t_ns;
+	float T[3];
+	float q[4];			///< w x y z, rotation from body to local
+} pose_entry_t;
+
+
+static int is_open = 0;
+static pose_entry_t buf[POSE_BUF_LEN];
+static int n_entries = 0;
+static int newest = -1;
+static uint32_t seq = 0;
+
+
+// Shepperd's method, picks the largest component to divide by
+static void _rot_to_quat(const float R[3][3], float q[4])
+{
+	float tr = R[0][0] + R[1][1] + R[2][2];
+	if(tr>0.0f){
+		float s = 2.0f*sqrtf(tr+1.0f);
+		q[0] = 0.25f*s;
+		q[1] = (R[2][1]-R[1][2])/s;
+		q[2] = (R[0][2]-R[2][0])/s;
+		q[3] = (R[1][0]-R[0][1])/s;
+	}
+	else if(R[0][0]>R[1][1] && R[0][0]>R[2][2]){
+		float s = 2.0f*sqrtf(1.0f+R[0][0]-R[1][1]-R[2][2]);
+		q[0] = (R[2][1]-R[1][2])/s;
+		q[1] = 0.25f*s;
+		q[2] = (R[0][1]+R[1][0])/s;
+		q[3] = (R[0][2]+R[2][0])/s;
+	}
+	else if(R[1][1]>R[2][2]){
+		float s = 2.0f*sqrtf(1.0f+R[1][1]-R[0][0]-R[2][2]);
+		q[0] = (R[0][2]-R[2][0])/s;
+		q[1] = (R[0][1]+R[1][0])/s;
+		q[2] = 0.25f*s;
+		q[3] = (R[1][2]+R[2][1])/s;
+	}
+	else{
+		float s = 2.0f*sqrtf(1.0f+R[2][2]-R[0][0]-R[1][1]);
+		q[0] = (R[1][0]-R[0][1])/s;
+		q[1] = (R[0][2]+R[2][0])/s;
+		q[2] = (R[1][2]+R[2][1])/s;
+		q[3] = 0.25f*s;
+	}
+}
+
+
+static void _quat_to_rot(const float q[4], float R[3][3])
+{
+	float w=q[0], x=q[1], y=q[2], z=q[3];
+	R[0][0] = 1.0f-2.0f*(y*y+z*z);	R[0][1] = 2.0f*(x*y-w*z);		R[0][2] = 2.0f*(x*z+w*y);
+	R[1][0] = 2.0f*(x*y+w*z);		R[1][1] = 1.0f-2.0f*(x*x+z*z);	R[1][2] = 2.0f*(y*z-w*x);
+	R[2][0] = 2.0f*(x*z-w*y);		R[2][1] = 2.0f*(y*z+w*x);		R[2][2] = 1.0f-2.0f*(x*x+y*y);
+}
+
+
+static void _add(int64_t t_ns, const float T[3], const float R[3][3])
+{
+	// ignore out of order messages, interpolation needs them sorted
+	if(newest>=0 && t_ns <= buf[newest].t_ns) return;
+
+	int i = (newest+1) % POSE_BUF_LEN;
+
+	__atomic_store_n(&seq, seq+1, __ATOMIC_RELAXED);
+	__atomic_thread_fence(__ATOMIC_RELEASE);
+	buf[i].t_ns = t_ns;
+	memcpy(buf[i].T, T, sizeof(buf[i].T));
+	_rot_to_quat(R, buf[i].q);
+	__atomic_store_n(&newest, i, __ATOMIC_RELAXED);
+	if(n_entries<POSE_BUF_LEN) __atomic_store_n(&n_entries, n_entries+1, __ATOMIC_RELAXED);
+	__atomic_store_n(&seq, seq+1, __ATOMIC_RELEASE);
+}
+
+
+static void _pose_helper_cb(__attribute__((unused)) int ch, char* data, int bytes, \
+									__attribute__((unused)) void* context)
+{
+	int n_packets;
+	pose_vel_6dof_t* d = pipe_validate_pose_vel_6dof_t(data, bytes, &n_packets);
+	if(d==NULL) return;
+
+	// copy out of the packed struct before use
+	for(int p=0; p<n_packets; p++){
+		float T[3];
+		float R[3][3];
+		for(int i=0; i<3; i++){
+			T[i] = d[p].T_child_wrt_parent[i];
+			for(int j=0; j<3; j++) R[i][j] = d[p].R_child_to_parent[i][j];
+		}
+		_add(d[p].timestamp_ns, T, R);
+	}
+	return;
+}
+
+
+int pose_init(void)
+{
+	if(is_open) return 0;
+
+	pipe_client_set_simple_helper_cb(POSE_PIPE_CH, _pose_helper_cb, NULL);
+	pipe_client_open(POSE_PIPE_CH, pose_pipe, PROCESS_NAME, \
+					EN_PIPE_CLIENT_SIMPLE_HELPER | EN_PIPE_CLIENT_AUTO_RECONNECT, \
+									POSE_VEL_6DOF_RECOMMENDED_READ_BUF_SIZE);
+	is_open = 1;
+	return 0;
+}
+
+
+// find the entries either side of t_ns, returns -1 if t_ns isn't covered.
+// n and head may be torn by a racing writer, the caller's seqlock check
+// throws that result away but they still mustn't index outside the ring
+static int _bracket(int n, int head, int64_t t_ns, int64_t max_age_ns, \
+										pose_entry_t* before, pose_entry_t* after)
+{
+	if(n<1 || n>POSE_BUF_LEN || head<0 || head>=POSE_BUF_LEN) return -1;
+
+	int i_after = head;
+
+	// past the newest, hold it if it's fresh enough
+	if(t_ns >= buf[i_after].t_ns){
+		if(t_ns - buf[i_after].t_ns > max_age_ns) return -1;
+		*before = buf[i_after];
+		*after = buf[i_after];
+		return 0;
+	}
+
+	// walk backwards to find the pair that brackets t_ns
+	for(int k=1; k<n; k++){
+		int i_before = (head-k+POSE_BUF_LEN) % POSE_BUF_LEN;
+		if(buf[i_before].t_ns <= t_ns){
+			*before = buf[i_before];
+			*after = buf[i_after];
+			return 0;
+		}
+		i_after = i_before;
+	}
+
+	// older than everything we have
+	return -1;
+}
+
+
+int pose_get(int64_t t_ns, int64_t max_age_ns, float T[3], float R[3][3])
+{
+	pose_entry_t a, b;
+	int ret = -1;
+
+	// only copy the two entries we need rather than the whole ring
+	int i;
+	for(i=0; i<100; i++){
+		uint32_t s1 = __atomic_load_n(&seq, __ATOMIC_ACQUIRE);
+		if(s1 & 1) continue;
+		int n = __atomic_load_n(&n_entries, __ATOMIC_RELAXED);
+		int head = __atomic_load_n(&newest, __ATOMIC_RELAXED);
+		ret = _bracket(n, head, t_ns, max_age_ns, &a, &b);
+		__atomic_thread_fence(__ATOMIC_ACQUIRE);
+		uint32_t s2 = __atomic_load_n(&seq, __ATOMIC_RELAXED);
+		if(s1==s2) break;
+	}
+	if(i==100 || ret) return -1;
+
+	float f = 0.0f;
+	if(b.t_ns > a.t_ns) f = (float)(t_ns - a.t_ns) / (float)(b.t_ns - a.t_ns);
+
+	for(int k=0; k<3; k++) T[k] = a.T[k] + f*(b.T[k]-a.T[k]);
+
+	// poses are only a few ms apart so normalized lerp is as good as slerp,
+	// take the short way around
+	float dot = a.q[0]*b.q[0] + a.q[1]*b.q[1] + a.q[2]*b.q[2] + a.q[3]*b.q[3];
+	float sign = dot<0.0f ? -1.0f : 1.0f;
+	float q[4];
+	float len = 0.0f;
+	for(int k=0; k<4; k++){
+		q[k] = a.q[k] + f*(sign*b.q[k]-a.q[k]);
+		len += q[k]*q[k];
+	}
+	len = sqrtf(len);
+	for(int k=0; k<4; k++) q[k] /= len;
+	_quat_to_rot(q, R);
+	return 0;
+}
+
+
+void pose_stop(void)
+{
+	if(!is_open) return;
+	pipe_client_close(POSE_PIPE_CH);
+	is_open = 0;
+	return;
+}
@@ -0,0 +1,63 @@
+/*******************************************************************************
+ * Copyright 2023 ModalAI Inc.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * 4. The Software is used solely in conjunction with devices provided by
+ *    ModalAI Inc.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ ******************************************************************************/
+
+
+#ifndef POSE_H
+#define POSE_H
+
+#include <stdint.h>
+
+// about 1s of VIO, or a third of a second at the vvhub rate
+#define POSE_BUF_LEN	64
+
+// subscribe to pose_pipe, safe to call more than once
+int pose_init(void);
+
+/**
+ * @brief      get the body pose in the local frame at a given time,
+ *             interpolated between the two poses either side of it. Past the
+ *             newest pose it is held for up to max_age_ns.
+ *
+ * @param[in]  t_ns        time to look up, clock_monotonic
+ * @param[in]  max_age_ns  how far past the newest pose to hold it
+ * @param[out] T           body position wrt local, m
+ * @param[out] R           rotation from body to local
+ *
+ * @return     0 on success, -1 if t_ns isn't covered by the ring
+ */
+int pose_get(int64_t t_ns, int64_t max_age_ns, float T[3], float R[3][3]);
+
+void pose_stop(void);
+
+
+#endif // end #define POSE_H
@@ -0,0 +1,344 @@
+/*******************************************************************************
+ * Copyright 2023 ModalAI Inc.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * 4. The Software is used solely in conjunction with devices provided by
+ *    ModalAI Inc.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ ******************************************************************************/
+
+
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <modal_json.h>
+#include <modal_pipe_client.h>
+#include <modal_pipe_server.h>
+#include <voxl_rangefinder_interface.h>
+
+#include "predictor.h"
+#include "attitude.h"
+#include "common.h"
+#include "config_file.h"
+
+#define GRAVITY				9.80665f
+
+// stop predicting if the rangefinder has been quiet this long
+#define MAX_COAST_NS		1000000000
+
+// ignore IMU gaps longer than this rather than integrating across them
+#define MAX_IMU_DT_S		0.1f
+
+// smallest measurement sigma we'll believe
+#define MIN_SD_M			0.005f
+
+// system-wide sensor extrinsics, checked for the body to IMU rotation
+#define EXTRINSICS_PATH		"/etc/modalai/extrinsics.conf"
+
+
+/**
+ * two state Kalman filter, height and vertical velocity both positive up.
+ * vertical acceleration from the IMU is the control input.
+ */
+typedef struct filter_t{
+	int initialized;
+	int64_t t_ns;			///< time the state is valid at
+	float h;
+	float v;
+	float P[2][2];
+	int64_t last_update_ns;
+	uint32_t n_updates;
+} filter_t;
+
+
+static int ch = -1;
+static filter_t f;
+static int64_t period_ns;
+static int64_t last_publish_ns = 0;
+static float R_imu_to_body[3][3];
+static pthread_mutex_t mtx = PTHREAD_MUTEX_INITIALIZER;
+
+
+// rotation from intrinsic XYZ Tait-Bryan angles in degrees, the convention
+// of RPY_parent_to_child in extrinsics.conf. With body as the parent this
+// takes vectors in IMU frame to body frame, R = Rx(roll) Ry(pitch) Rz(yaw)
+static void _rpy_to_rotation(const float rpy_deg[3], float R[3][3])
+{
+	float d2r = (float)M_PI/180.0f;
+	float sr = sinf(rpy_deg[0]*d2r), cr = cosf(rpy_deg[0]*d2r);
+	float sp = sinf(rpy_deg[1]*d2r), cp = cosf(rpy_deg[1]*d2r);
+	float sy = sinf(rpy_deg[2]*d2r), cy = cosf(rpy_deg[2]*d2r);
+
+	R[0][0] =  cp*cy;
+	R[0][1] = -cp*sy;
+	R[0][2] =  sp;
+	R[1][0] =  cr*sy + sr*sp*cy;
+	R[1][1] =  cr*cy - sr*sp*sy;
+	R[1][2] = -sr*cp;
+	R[2][0] =  sr*sy - cr*sp*cy;
+	R[2][1] =  sr*cy + cr*sp*sy;
+	R[2][2] =  cr*cp;
+	return;
+}
+
+
+// look for the body to predictor_imu_pipe entry in extrinsics.conf
+static int _load_imu_extrinsic(float rpy_deg[3])
+{
+	if(access(EXTRINSICS_PATH, F_OK)) return -1;
+	cJSON* parent = json_read_file(EXTRINSICS_PATH);
+	if(parent==NULL) return -1;
+
+	int ret = -1;
+	cJSON* list = cJSON_GetObjectItem(parent, "extrinsics");
+	int n = list==NULL ? 0 : cJSON_GetArraySize(list);
+
+	for(int i=0; i<n && ret; i++){
+		cJSON* item = cJSON_GetArrayItem(list, i);
+		char* p = cJSON_GetStringValue(cJSON_GetObjectItem(item, "parent"));
+		char* c = cJSON_GetStringValue(cJSON_GetObjectItem(item, "child"));
+		cJSON* rpy = cJSON_GetObjectItem(item, "RPY_parent_to_child");
+		if(p==NULL || c==NULL || rpy==NULL || cJSON_GetArraySize(rpy)!=3) continue;
+		if(strcmp(p, "body") || strcmp(c, predictor_imu_pipe)) continue;
+
+		for(int j=0; j<3; j++){
+			rpy_deg[j] = (float)cJSON_GetArrayItem(rpy, j)->valuedouble;
+		}
+		ret = 0;
+	}
+
+	cJSON_Delete(parent);
+	return ret;
+}
+
+
+static void _predict(float dt, float a_up)
+{
+	float q = predictor_accel_noise*predictor_accel_noise;
+	float dt2 = dt*dt;
+
+	f.h += f.v*dt + 0.5f*a_up*dt2;
+	f.v += a_up*dt;
+
+	// P = F P F' + Q with F = [1 dt; 0 1]
+	float p00 = f.P[0][0] + dt*(f.P[1][0] + f.P[0][1]) + dt2*f.P[1][1];
+	float p01 = f.P[0][1] + dt*f.P[1][1];
+	float p11 = f.P[1][1];
+	f.P[0][0] = p00 + q*dt2*dt2*0.25f;
+	f.P[0][1] = p01 + q*dt2*dt*0.5f;
+	f.P[1][0] = f.P[0][1];
+	f.P[1][1] = p11 + q*dt2;
+	return;
+}
+
+
+static void _publish(void)
+{
+	if(pipe_server_get_num_clients(ch)<=0) return;
+
+	rangefinder_height_pred_t p;
+	p.magic_number		= RANGEFINDER_HEIGHT_PRED_MAGIC_NUMBER;
+	p.n_updates			= f.n_updates;
+	p.timestamp_ns		= f.t_ns;
+	p.height_m			= f.h;
+	p.vz_ms				= f.v;
+	p.height_sd_m		= sqrtf(f.P[0][0]);
+	p.vz_sd_ms			= sqrtf(f.P[1][1]);
+	p.last_update_ns	= f.last_update_ns;
+	pipe_server_write(ch, &p, sizeof(p));
+	return;
+}
+
+
+static void _imu_helper_cb(__attribute__((unused)) int ch, char* data, int bytes, \
+									__attribute__((unused)) void* context)
+{
+	int n_packets;
+	imu_data_t* d = pipe_validate_imu_data_t(data, bytes, &n_packets);
+	if(d==NULL) return;
+
+	pthread_mutex_lock(&mtx);
+
+	for(int i=0; i<n_packets; i++){
+		int64_t t_ns = d[i].timestamp_ns;
+		if(!f.initialized || t_ns <= f.t_ns) continue;
+
+		// coasting too long, wait for the next rangefinder reading
+		if(t_ns - f.last_update_ns > MAX_COAST_NS){
+			f.initialized = 0;
+			break;
+		}
+
+		// accl_ms2 is specific force in the IMU's own frame, rotate it into
+		// body FRD where it reads (0,0,-g) when level and at rest
+		float a[3] = {d[i].accl_ms2[0], d[i].accl_ms2[1], d[i].accl_ms2[2]};
+		float fb[3];
+		for(int j=0; j<3; j++){
+			fb[j] = R_imu_to_body[j][0]*a[0] + R_imu_to_body[j][1]*a[1] + R_imu_to_body[j][2]*a[2];
+		}
+
+		// level it with the autopilot roll and pitch (body FRD wrt NED),
+		// assume level if the autopilot isn't sending attitude. Adding g
+		// leaves the kinematic acceleration, positive down.
+		float roll = 0.0f, pitch = 0.0f, yaw;
+		attitude_get(t_ns, ATTITUDE_MAX_AGE_NS, &roll, &pitch, &yaw);
+		float sr = sinf(roll);
+		float cr = cosf(roll);
+		float sp = sinf(pitch);
+		float cp = cosf(pitch);
+		float a_down = -sp*fb[0] + cp*sr*fb[1] + cp*cr*fb[2] + GRAVITY;
+
+		float dt = (float)(t_ns - f.t_ns) / 1000000000.0f;
+		if(dt < MAX_IMU_DT_S) _predict(dt, -a_down);
+		f.t_ns = t_ns;
+
+		if(t_ns - last_publish_ns >= period_ns){
+			_publish();
+			last_publish_ns = t_ns;
+		}
+	}
+
+	pthread_mutex_unlock(&mtx);
+	return;
+}
+
+
+void predictor_add_height(int64_t t_ns, float height_m, float sd_m)
+{
+	if(ch<0) return;
+	if(sd_m < MIN_SD_M) sd_m = MIN_SD_M;
+	float r = sd_m*sd_m;
+
+	pthread_mutex_lock(&mtx);
+
+	if(!f.initialized){
+		memset(&f, 0, sizeof(f));
+		f.initialized = 1;
+		f.t_ns = t_ns;
+		f.h = height_m;
+		f.P[0][0] = r;
+		f.P[1][1] = 1.0f;
+		f.last_update_ns = t_ns;
+		f.n_updates = 1;
+		pthread_mutex_unlock(&mtx);
+		return;
+	}
+
+	// the state has usually been propagated past the reading by the IMU so
+	// compare against the height back at t_ns, H = [1 -lag]
+	float lag = (float)(f.t_ns - t_ns) / 1000000000.0f;
+	if(lag < 0.0f){
+		_predict(-lag, 0.0f);
+		f.t_ns = t_ns;
+		lag = 0.0f;
+	}
+	float y = height_m - (f.h - lag*f.v);
+
+	// S = H P H' + R, K = P H' / S
+	float ph0 = f.P[0][0] - lag*f.P[0][1];
+	float ph1 = f.P[1][0] - lag*f.P[1][1];
+	float s = ph0 - lag*ph1 + r;
+	float k0 = ph0/s;
+	float k1 = ph1/s;
+
+	f.h += k0*y;
+	f.v += k1*y;
+
+	// P = P - K H P
+	float p00 = f.P[0][0] - k0*ph0;
+	float p01 = f.P[0][1] - k0*ph1;
+	float p11 = f.P[1][1] - k1*ph1;
+	f.P[0][0] = p00;
+	f.P[0][1] = p01;
+	f.P[1][0] = p01;
+	f.P[1][1] = p11;
+
+	f.last_update_ns = t_ns;
+	f.n_updates++;
+
+	pthread_mutex_unlock(&mtx);
+	return;
+}
+
+
+int predictor_init(void)
+{
+	if(!en_height_predictor) return 0;
+
+	if(predictor_rate_hz <= 0.0f){
+		fprintf(stderr, "ERROR in %s, predictor_rate_hz must be positive\n", __FUNCTION__);
+		return -1;
+	}
+	period_ns = (int64_t)(1000000000.0f/predictor_rate_hz);
+	memset(&f, 0, sizeof(f));
+
+	float rpy_deg[3];
+	if(_load_imu_extrinsic(rpy_deg)==0){
+		printf("using %s extrinsic for %s: rpy %0.1f %0.1f %0.1f deg\n", EXTRINSICS_PATH, \
+				predictor_imu_pipe, (double)rpy_deg[0], (double)rpy_deg[1], (double)rpy_deg[2]);
+	}
+	else{
+		for(int j=0; j<3; j++) rpy_deg[j] = predictor_imu_rpy_deg[j];
+		printf("no body to %s extrinsic in %s, using predictor_imu_rpy_deg\n", \
+										predictor_imu_pipe, EXTRINSICS_PATH);
+	}
+	_rpy_to_rotation(rpy_deg, R_imu_to_body);
+
+	ch = pipe_server_get_next_available_channel();
+
+	pipe_info_t info = { \
+		.name        = RANGEFINDER_HEIGHT_PRED_PIPE_NAME,\
+		.location    = RANGEFINDER_HEIGHT_PRED_PIPE_LOCATION ,\
+		.type        = "rangefinder_height_pred_t",\
+		.server_name = PROCESS_NAME,\
+		.size_bytes  = RANGEFINDER_RECOMMENDED_PIPE_SIZE};
+
+	if(pipe_server_create(ch, info, 0)) return -1;
+
+	pipe_client_set_simple_helper_cb(IMU_PIPE_CH, _imu_helper_cb, NULL);
+	pipe_client_open(IMU_PIPE_CH, predictor_imu_pipe, PROCESS_NAME, \
+					EN_PIPE_CLIENT_SIMPLE_HELPER | EN_PIPE_CLIENT_AUTO_RECONNECT, \
+									IMU_RECOMMENDED_READ_BUF_SIZE);
+	return 0;
+}
+
+
+int predictor_num_clients(void)
+{
+	if(ch<0) return 0;
+	return pipe_server_get_num_clients(ch);
+}
+
+
+void predictor_stop(void)
+{
+	if(ch<0) return;
+	pipe_client_close(IMU_PIPE_CH);
+	return;
+}
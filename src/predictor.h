@@ -24,7 +24,7 @@
  * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
  * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
  * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
- * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR busINESS
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
  * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
  * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
  * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
@@ -32,35 +32,20 @@
  ******************************************************************************/
 
 
+#ifndef PREDICTOR_H
+#define PREDICTOR_H
 
-#ifndef VL53L1X_H
-#define VL53L1X_H
-
-
-#include <voxl_io/i2c.h>
 #include <stdint.h>
 
+// create the prediction pipe and subscribe to the IMU if en_height_predictor is set
+int predictor_init(void);
 
+int predictor_num_clients(void);
 
-void vl53l1x_set_en_debug(int en);
-
-int vl53l1x_start_ranging(void);
-
-int vl53l1x_stop_ranging(void);
-
-int vl53l1x_clear_interrupt(void);
-
-int vl53l1x_check_for_data_ready(uint8_t *isDataReady);
-
-int vl53l1x_get_distance_mm(int* dist_mm, int* sd_mm);
-
-int vl53l1x_set_bus_to_default_slave_address(void);
-
-int vl53l1x_swap_to_secondary_address(void);
+// fuse one tilt-compensated height reading taken at t_ns
+void predictor_add_height(int64_t t_ns, float height_m, float sd_m);
 
+void predictor_stop(void);
 
-int vl53l1x_check_whoami(int quiet);
-int vl53l1x_init(float fov_deg, int TimingBudgetInMs);
-int vl53l1x_wait_for_data(void);
 
-#endif // end #define VL53L1X_H
+#endif // end #define PREDICTOR_H
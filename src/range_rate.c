@@ -0,0 +1,181 @@
+/*******************************************************************************
+ * Copyright 2023 ModalAI Inc.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * 4. The Software is used solely in conjunction with devices provided by
+ *    ModalAI Inc.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ ******************************************************************************/
+
+
+#include <stdio.h>
+#include <string.h>
+#include <modal_pipe_server.h>
+#include <voxl_rangefinder_interface.h>
+
+#include "range_rate.h"
+#include "common.h"
+#include "config_file.h"
+
+// restart a filter after going this long without a valid reading
+#define MAX_GAP_NS			500000000
+
+// readings needed before the rate is trusted
+#define MIN_UPDATES			3
+
+// slower closing speeds than this are treated as not closing
+#define MIN_CLOSING_MS		0.01f
+
+
+/**
+ * alpha-beta filter on distance, constant memory per sensor. Invalid
+ * readings are simply not fed in so the filter coasts on its rate.
+ */
+typedef struct ab_filter_t{
+	int n_updates;			///< 0 means the filter needs restarting
+	int64_t t_ns;			///< time of the last valid reading
+	float d;				///< filtered distance, m
+	float v;				///< filtered range rate, m/s
+} ab_filter_t;
+
+
+static int ch = -1;
+static ab_filter_t filters[MAX_SENSORS];
+
+
+int range_rate_init(void)
+{
+	if(!en_range_rate) return 0;
+
+	memset(filters, 0, sizeof(filters));
+	ch = pipe_server_get_next_available_channel();
+
+	pipe_info_t info = { \
+		.name        = RANGEFINDER_RANGE_RATE_PIPE_NAME,\
+		.location    = RANGEFINDER_RANGE_RATE_PIPE_LOCATION ,\
+		.type        = "rangefinder_range_rate_t",\
+		.server_name = PROCESS_NAME,\
+		.size_bytes  = RANGEFINDER_RECOMMENDED_PIPE_SIZE};
+
+	return pipe_server_create(ch, info, 0);
+}
+
+
+int range_rate_num_clients(void)
+{
+	if(ch<0) return 0;
+	return pipe_server_get_num_clients(ch);
+}
+
+
+static void _update(ab_filter_t* f, int64_t t_ns, float z)
+{
+	// first reading or too long since the last one, start over
+	if(f->n_updates==0 || t_ns - f->t_ns > MAX_GAP_NS){
+		f->n_updates = 1;
+		f->t_ns = t_ns;
+		f->d = z;
+		f->v = 0.0f;
+		return;
+	}
+
+	float dt = (float)(t_ns - f->t_ns) / 1000000000.0f;
+	if(dt <= 0.0f) return;
+
+	// second reading, just difference to seed the rate
+	if(f->n_updates==1){
+		f->v = (z - f->d)/dt;
+		f->d = z;
+	}
+	else{
+		float pred = f->d + f->v*dt;
+		float r = z - pred;
+		f->d = pred + range_rate_alpha*r;
+		f->v += range_rate_beta*r/dt;
+	}
+	f->t_ns = t_ns;
+	f->n_updates++;
+	return;
+}
+
+
+int range_rate_publish(rangefinder_sample_ext_t* s, int n)
+{
+	if(ch<0) return 0;
+
+	// keep the filters running even without clients so they're warm
+	int64_t t_ns = s[0].sample.timestamp_ns;
+	for(int i=0; i<n; i++){
+		if(s[i].sample.status == RANGEFINDER_STATUS_VALID){
+			_update(&filters[i], t_ns, (float)s[i].sample.distance_mm*0.001f);
+		}
+	}
+
+	if(pipe_server_get_num_clients(ch)<=0) return 0;
+
+	int64_t now_ns = en_range_rate_latency_comp ? time_monotonic_ns() : t_ns;
+
+	rangefinder_range_rate_t out[MAX_SENSORS];
+	memset(out, 0, sizeof(rangefinder_range_rate_t)*n);
+
+	for(int i=0; i<n; i++){
+		ab_filter_t* f = &filters[i];
+		rangefinder_range_rate_t* o = &out[i];
+
+		o->magic_number	= RANGEFINDER_RANGE_RATE_MAGIC_NUMBER;
+		o->sample_id	= s[i].sample.sample_id;
+		o->timestamp_ns	= t_ns;
+		o->now_ns		= now_ns;
+		o->sensor_id	= enabled_sensors[i].sensor_id;
+		o->ttc_s		= -1.0f;
+
+		if(f->n_updates < MIN_UPDATES || t_ns - f->t_ns > MAX_GAP_NS){
+			o->distance_m		= -1.0f;
+			o->distance_now_m	= -1.0f;
+			o->status			= RANGEFINDER_STATUS_NO_DATA;
+			continue;
+		}
+
+		// the filter state is at the last valid reading, carry it forward.
+		// Pass the reading's own status through so consumers can tell a
+		// prediction from a measurement, age is capped by MAX_GAP_NS
+		float dt = (float)(t_ns - f->t_ns) / 1000000000.0f;
+		float dt_now = (float)(now_ns - f->t_ns) / 1000000000.0f;
+		o->distance_m		= f->d + f->v*dt;
+		o->range_rate_ms	= f->v;
+		o->distance_now_m	= f->d + f->v*dt_now;
+		o->status			= s[i].sample.status;
+		o->age_ms			= (uint16_t)((t_ns - f->t_ns)/1000000);
+
+		if(f->v < -MIN_CLOSING_MS){
+			float d = o->distance_now_m > 0.0f ? o->distance_now_m : 0.0f;
+			o->ttc_s = d / -f->v;
+		}
+	}
+
+	return pipe_server_write(ch, out, sizeof(rangefinder_range_rate_t)*n);
+}
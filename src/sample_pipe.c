@@ -0,0 +1,133 @@
+/*******************************************************************************
+ * Copyright 2023 ModalAI Inc.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * 4. The Software is used solely in conjunction with devices provided by
+ *    ModalAI Inc.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ ******************************************************************************/
+
+
+#include <stdio.h>
+#include <modal_pipe_server.h>
+#include <voxl_rangefinder_interface.h>
+
+#include "sample_pipe.h"
+#include "common.h"
+#include "config_file.h"
+
+
+static int ch = -1;
+static int ext_ch = -1;
+
+
+int sample_pipe_add_sensors_to_info(int channel)
+{
+	const char* type_strings[] = RANGEFINDER_TYPE_STRINGS;
+
+	cJSON* info = pipe_server_get_info_json_ptr(channel);
+	if(info==NULL){
+		fprintf(stderr, "ERROR in %s, failed to get info json\n", __FUNCTION__);
+		return -1;
+	}
+
+	cJSON* json_array = cJSON_CreateArray();
+	for(int i=0; i<n_enabled_sensors; i++){
+		rangefinder_config_t* s = &enabled_sensors[i];
+		cJSON* json_item = cJSON_CreateObject();
+		cJSON_AddItemToArray(json_array, json_item);
+
+		cJSON_AddNumberToObject(json_item, "sensor_index", i);
+		cJSON_AddNumberToObject(json_item, "sensor_id", s->sensor_id);
+		cJSON_AddStringToObject(json_item, "type", type_strings[s->type]);
+		cJSON_AddNumberToObject(json_item, "fov_deg", s->fov_deg);
+		cJSON_AddNumberToObject(json_item, "range_max_m", s->range_max_m);
+		cJSON_AddItemToObject(json_item, "location_wrt_body", cJSON_CreateFloatArray(s->location_wrt_body, 3));
+		cJSON_AddItemToObject(json_item, "direction_wrt_body", cJSON_CreateFloatArray(s->direction_wrt_body, 3));
+	}
+	cJSON_AddItemToObject(info, "sensors", json_array);
+
+	return pipe_server_update_info(channel);
+}
+
+
+int sample_pipe_init(void)
+{
+	ch = pipe_server_get_next_available_channel();
+
+	pipe_info_t info = { \
+		.name        = RANGEFINDER_SAMPLE_PIPE_NAME,\
+		.location    = RANGEFINDER_SAMPLE_PIPE_LOCATION ,\
+		.type        = "rangefinder_sample_t",\
+		.server_name = PROCESS_NAME,\
+		.size_bytes  = RANGEFINDER_RECOMMENDED_PIPE_SIZE};
+
+	if(pipe_server_create(ch, info, 0)) return -1;
+	if(sample_pipe_add_sensors_to_info(ch)) return -1;
+
+	if(!en_extended_output) return 0;
+
+	ext_ch = pipe_server_get_next_available_channel();
+
+	pipe_info_t ext_info = { \
+		.name        = RANGEFINDER_SAMPLE_EXT_PIPE_NAME,\
+		.location    = RANGEFINDER_SAMPLE_EXT_PIPE_LOCATION ,\
+		.type        = "rangefinder_sample_ext_t",\
+		.server_name = PROCESS_NAME,\
+		.size_bytes  = RANGEFINDER_RECOMMENDED_PIPE_SIZE};
+
+	if(pipe_server_create(ext_ch, ext_info, 0)) return -1;
+	if(sample_pipe_add_sensors_to_info(ext_ch)) return -1;
+
+	return 0;
+}
+
+
+int sample_pipe_num_clients(void)
+{
+	int n = 0;
+	if(ch>=0)		n += pipe_server_get_num_clients(ch);
+	if(ext_ch>=0)	n += pipe_server_get_num_clients(ext_ch);
+	return n;
+}
+
+
+int sample_pipe_publish(rangefinder_sample_ext_t* s, int n)
+{
+	int i;
+
+	if(ext_ch>=0 && pipe_server_get_num_clients(ext_ch)>0){
+		pipe_server_write(ext_ch, s, sizeof(rangefinder_sample_ext_t)*n);
+	}
+
+	if(ch<0 || pipe_server_get_num_clients(ch)<=0) return 0;
+
+	// pack the compact part contiguously for the regular pipe
+	rangefinder_sample_t compact[MAX_SENSORS];
+	for(i=0; i<n; i++) compact[i] = s[i].sample;
+	return pipe_server_write(ch, compact, sizeof(rangefinder_sample_t)*n);
+}
@@ -0,0 +1,96 @@
+/*******************************************************************************
+ * Copyright 2023 ModalAI Inc.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * 4. The Software is used solely in conjunction with devices provided by
+ *    ModalAI Inc.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ ******************************************************************************/
+
+
+#include <stdio.h>
+#include <modal_pipe_server.h>
+#include <voxl_rangefinder_interface.h>
+
+#include "sensor_pipes.h"
+#include "common.h"
+#include "config_file.h"
+
+
+// channel for each sensor, indexed the same as enabled_sensors
+static int n_ch = 0;
+static int ch[MAX_SENSORS];
+
+
+int sensor_pipes_init(void)
+{
+	if(!en_per_sensor_pipes) return 0;
+
+	for(int i=0; i<n_enabled_sensors; i++){
+
+		pipe_info_t info = { \
+			.type        = "rangefinder_data_t",\
+			.server_name = PROCESS_NAME,\
+			.size_bytes  = RANGEFINDER_RECOMMENDED_PIPE_SIZE};
+
+		snprintf(info.name, sizeof(info.name), RANGEFINDER_SENSOR_PIPE_PREFIX "%d", \
+												enabled_sensors[i].sensor_id);
+		snprintf(info.location, sizeof(info.location), "%s%s/", \
+												MODAL_PIPE_DEFAULT_BASE_DIR, info.name);
+
+		ch[i] = pipe_server_get_next_available_channel();
+		if(pipe_server_create(ch[i], info, 0)){
+			fprintf(stderr, "ERROR failed to create pipe %s\n", info.name);
+			return -1;
+		}
+		n_ch++;
+	}
+
+	return 0;
+}
+
+
+int sensor_pipes_num_clients(void)
+{
+	int n = 0;
+	for(int i=0; i<n_ch; i++){
+		n += pipe_server_get_num_clients(ch[i]);
+	}
+	return n;
+}
+
+
+int sensor_pipes_publish(rangefinder_data_t* d, int n)
+{
+	if(n>n_ch) n = n_ch;
+
+	for(int i=0; i<n; i++){
+		if(pipe_server_get_num_clients(ch[i])<=0) continue;
+		pipe_server_write(ch[i], &d[i], sizeof(rangefinder_data_t));
+	}
+	return 0;
+}
@@ -0,0 +1,125 @@
+/*******************************************************************************
+ * Copyright 2023 ModalAI Inc.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * 4. The Software is used solely in conjunction with devices provided by
+ *    ModalAI Inc.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ ******************************************************************************/
+
+
+#include <stdio.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <voxl_rangefinder_interface.h>
+#include <voxl_rangefinder_shm.h>
+
+#include "shm_latest.h"
+#include "common.h"
+#include "config_file.h"
+
+
+static rangefinder_shm_t* shm = NULL;
+
+
+int shm_latest_init(void)
+{
+	if(!en_shm_latest) return 0;
+
+	if(n_enabled_sensors>RANGEFINDER_SHM_MAX_SENSORS){
+		fprintf(stderr, "ERROR in %s, too many sensors for shared memory\n", __FUNCTION__);
+		return -1;
+	}
+
+	// start fresh in case a previous instance crashed and left it behind
+	shm_unlink(RANGEFINDER_SHM_NAME);
+	int fd = shm_open(RANGEFINDER_SHM_NAME, O_CREAT | O_RDWR, 0644);
+	if(fd<0){
+		perror("ERROR failed to create rangefinder shared memory");
+		return -1;
+	}
+	if(ftruncate(fd, sizeof(rangefinder_shm_t))){
+		perror("ERROR failed to size rangefinder shared memory");
+		close(fd);
+		return -1;
+	}
+	void* ptr = mmap(NULL, sizeof(rangefinder_shm_t), PROT_READ|PROT_WRITE, MAP_SHARED, fd, 0);
+	close(fd);
+	if(ptr==MAP_FAILED){
+		perror("ERROR failed to map rangefinder shared memory");
+		return -1;
+	}
+	shm = (rangefinder_shm_t*)ptr;
+
+	// fill in everything before the magic number so readers never see a
+	// half-initialized header
+	memset(shm, 0, sizeof(rangefinder_shm_t));
+	shm->version = RANGEFINDER_SHM_VERSION;
+	shm->n_sensors = n_enabled_sensors;
+	shm->server_pid = getpid();
+	for(int i=0; i<n_enabled_sensors; i++){
+		shm->sensor_id[i] = enabled_sensors[i].sensor_id;
+		shm->slot[i].sample.magic_number = RANGEFINDER_SAMPLE_MAGIC_NUMBER;
+		shm->slot[i].sample.distance_mm = -1;
+		shm->slot[i].sample.status = RANGEFINDER_STATUS_NO_DATA;
+		shm->slot[i].sample.sensor_index = i;
+	}
+	__atomic_store_n(&shm->magic_number, RANGEFINDER_SHM_MAGIC_NUMBER, __ATOMIC_RELEASE);
+
+	return 0;
+}
+
+
+int shm_latest_publish(rangefinder_sample_ext_t* s, int n)
+{
+	if(shm==NULL) return 0;
+	if(n>(int)shm->n_sensors) n = shm->n_sensors;
+
+	for(int i=0; i<n; i++){
+		rangefinder_shm_slot_t* slot = &shm->slot[i];
+		uint32_t seq = slot->seq;
+		__atomic_store_n(&slot->seq, seq+1, __ATOMIC_RELAXED);
+		__atomic_thread_fence(__ATOMIC_RELEASE);
+		memcpy(&slot->sample, &s[i].sample, sizeof(rangefinder_sample_t));
+		__atomic_store_n(&slot->seq, seq+2, __ATOMIC_RELEASE);
+	}
+	return 0;
+}
+
+
+void shm_latest_cleanup(void)
+{
+	if(shm==NULL) return;
+	// readers that still have it mapped check this to see it's stale
+	__atomic_store_n(&shm->magic_number, 0, __ATOMIC_RELEASE);
+	munmap(shm, sizeof(rangefinder_shm_t));
+	shm_unlink(RANGEFINDER_SHM_NAME);
+	shm = NULL;
+	return;
+}
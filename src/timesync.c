@@ -0,0 +1,195 @@
+/*******************************************************************************
+ * Copyright 2023 ModalAI Inc.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * 4. The Software is used solely in conjunction with devices provided by
+ *    ModalAI Inc.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ ******************************************************************************/
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <pthread.h>
+
+#include "timesync.h"
+
+// ignore round trips longer than this, they say little about the offset
+#define MAX_RTT_NS		50000000
+
+// a jump this big means the autopilot rebooted, start over
+#define RESET_THRESHOLD_NS	1000000000
+
+
+typedef struct measurement_t{
+	int64_t offset_ns;
+	int64_t cost_ns;	///< rtt for TIMESYNC, the raw offset itself for SYSTEM_TIME
+} measurement_t;
+
+
+static measurement_t window[TIMESYNC_WINDOW];
+static int n_window = 0;
+static int next = 0;
+static int have_timesync = 0;		// once set, SYSTEM_TIME is ignored
+static int64_t offset_ns = 0;
+static double jitter_ms = 0.0;
+static int has_estimate = 0;
+static uint32_t generation = 0;	// bumped every time the estimate starts over
+static pthread_mutex_t mtx = PTHREAD_MUTEX_INITIALIZER;
+
+
+// add a measurement and pick the new estimate from the one with lowest cost
+static void _add(int64_t offset, int64_t cost)
+{
+	int i;
+
+	if(has_estimate && llabs(offset-offset_ns) > RESET_THRESHOLD_NS){
+		printf("autopilot clock jumped, restarting time sync\n");
+		n_window = 0;
+		next = 0;
+		has_estimate = 0;
+		generation++;
+	}
+
+	window[next].offset_ns = offset;
+	window[next].cost_ns = cost;
+	next = (next+1) % TIMESYNC_WINDOW;
+	if(n_window<TIMESYNC_WINDOW) n_window++;
+
+	int best = 0;
+	double mean = 0.0;
+	for(i=0; i<n_window; i++){
+		if(window[i].cost_ns < window[best].cost_ns) best = i;
+		mean += (double)(window[i].offset_ns - window[0].offset_ns);
+	}
+	mean /= n_window;
+
+	double var = 0.0;
+	for(i=0; i<n_window; i++){
+		double e = (double)(window[i].offset_ns - window[0].offset_ns) - mean;
+		var += e*e;
+	}
+
+	if(!has_estimate){
+		printf("time synchronized with autopilot, offset %0.3fs\n", \
+								(double)window[best].offset_ns/1000000000.0);
+	}
+	offset_ns = window[best].offset_ns;
+	jitter_ms = sqrt(var/n_window)/1000000.0;
+	has_estimate = 1;
+	return;
+}
+
+
+void timesync_add_timesync(int64_t ap_ns, int64_t sent_ns, int64_t received_ns)
+{
+	int64_t rtt = received_ns - sent_ns;
+	if(rtt<0 || rtt>MAX_RTT_NS) return;
+
+	pthread_mutex_lock(&mtx);
+	// switch over from SYSTEM_TIME the first time we get a round trip
+	if(!have_timesync){
+		have_timesync = 1;
+		n_window = 0;
+		next = 0;
+	}
+	// assume the autopilot stamped the reply halfway through the round trip
+	_add(sent_ns + rtt/2 - ap_ns, rtt);
+	pthread_mutex_unlock(&mtx);
+	return;
+}
+
+
+void timesync_add_system_time(uint32_t ap_boot_ms, int64_t received_ns)
+{
+	pthread_mutex_lock(&mtx);
+	if(!have_timesync){
+		// transport delay only ever makes this larger than the true offset
+		// so the smallest one in the window is the best
+		int64_t offset = received_ns - (int64_t)ap_boot_ms*1000000;
+		_add(offset, offset);
+	}
+	pthread_mutex_unlock(&mtx);
+	return;
+}
+
+
+int timesync_to_autopilot_ns(int64_t monotonic_ns, int64_t* ap_ns)
+{
+	pthread_mutex_lock(&mtx);
+	int ret = has_estimate ? 0 : -1;
+	*ap_ns = monotonic_ns - offset_ns;
+	pthread_mutex_unlock(&mtx);
+	return ret;
+}
+
+
+int timesync_to_monotonic_ns(int64_t ap_ns, int64_t* monotonic_ns)
+{
+	pthread_mutex_lock(&mtx);
+	int ret = has_estimate ? 0 : -1;
+	*monotonic_ns = ap_ns + offset_ns;
+	pthread_mutex_unlock(&mtx);
+	return ret;
+}
+
+
+int timesync_get_offset(int64_t* offset, double* jitter)
+{
+	pthread_mutex_lock(&mtx);
+	int ret = has_estimate ? 0 : -1;
+	*offset = offset_ns;
+	*jitter = jitter_ms;
+	pthread_mutex_unlock(&mtx);
+	return ret;
+}
+
+
+void timesync_reset(void)
+{
+	pthread_mutex_lock(&mtx);
+	n_window = 0;
+	next = 0;
+	have_timesync = 0;
+	has_estimate = 0;
+	offset_ns = 0;
+	jitter_ms = 0.0;
+	generation++;
+	pthread_mutex_unlock(&mtx);
+	return;
+}
+
+
+uint32_t timesync_get_generation(void)
+{
+	pthread_mutex_lock(&mtx);
+	uint32_t ret = generation;
+	pthread_mutex_unlock(&mtx);
+	return ret;
+}
@@ -0,0 +1,78 @@
+/*******************************************************************************
+ * Copyright 2023 ModalAI Inc.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * 4. The Software is used solely in conjunction with devices provided by
+ *    ModalAI Inc.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ ******************************************************************************/
+
+
+#ifndef TIMESYNC_H
+#define TIMESYNC_H
+
+#include <stdint.h>
+
+/**
+ * Estimates the offset between our CLOCK_MONOTONIC and the autopilot's boot
+ * time so readings can be stamped with when they were actually measured.
+ *
+ * offset_ns = monotonic_ns - autopilot_boot_ns
+ *
+ * TIMESYNC round trips are preferred since the round trip time bounds the
+ * error. SYSTEM_TIME is used until the first TIMESYNC reply arrives. Only the
+ * last TIMESYNC_WINDOW measurements are kept.
+ */
+#define TIMESYNC_WINDOW	16
+
+// a TIMESYNC reply to one of our requests, all times in ns
+void timesync_add_timesync(int64_t ap_ns, int64_t sent_ns, int64_t received_ns);
+
+// a SYSTEM_TIME message from the autopilot received at received_ns
+void timesync_add_system_time(uint32_t ap_boot_ms, int64_t received_ns);
+
+// convert a monotonic timestamp to autopilot boot time in ns
+// returns -1 if there is no estimate yet
+int timesync_to_autopilot_ns(int64_t monotonic_ns, int64_t* ap_ns);
+
+// convert an autopilot boot timestamp to CLOCK_MONOTONIC in ns
+// returns -1 if there is no estimate yet
+int timesync_to_monotonic_ns(int64_t ap_ns, int64_t* monotonic_ns);
+
+// current offset and the standard deviation of the measurements in the window
+// returns -1 if there is no estimate yet
+int timesync_get_offset(int64_t* offset_ns, double* jitter_ms);
+
+void timesync_reset(void);
+
+// changes whenever the estimate is thrown away, either by timesync_reset() or
+// because the autopilot clock jumped. Anything stamped with the old offset
+// should be dropped when this changes.
+uint32_t timesync_get_generation(void);
+
+
+#endif // end #define TIMESYNC_H
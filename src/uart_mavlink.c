@@ -0,0 +1,204 @@
+/*******************************************************************************
+ * Copyright 2023 ModalAI Inc.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * 4. The Software is used solely in conjunction with devices provided by
+ *    ModalAI Inc.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ ******************************************************************************/
+
+
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <termios.h>
+#include <unistd.h>
+
+#include "uart_mavlink.h"
+#include "common.h"
+#include "config_file.h"
+
+
+// room for one cycle of DISTANCE_SENSOR frames
+#define BUF_SIZE	(MAX_SENSORS*MAVLINK_MAX_PACKET_LEN)
+
+static int fd = -1;
+static uint8_t buf[BUF_SIZE];
+static int n_pending = 0;	// bytes at the start of buf still waiting to go out
+
+// stats since the last print
+static uint64_t n_frames = 0;
+static uint64_t n_dropped = 0;
+static int64_t write_ns_sum = 0;
+static int64_t write_ns_max = 0;
+static int64_t age_ns_sum = 0;
+static int64_t age_ns_max = 0;
+static uint64_t n_writes = 0;
+
+
+static speed_t _baud_to_speed(int baud)
+{
+	switch(baud){
+		case 57600:		return B57600;
+		case 115200:	return B115200;
+		case 230400:	return B230400;
+		case 460800:	return B460800;
+		case 921600:	return B921600;
+		case 1000000:	return B1000000;
+		case 1500000:	return B1500000;
+		case 2000000:	return B2000000;
+		case 3000000:	return B3000000;
+		default:		return B0;
+	}
+}
+
+
+int uart_mavlink_init(void)
+{
+	if(mavlink_uart[0]==0) return 0;
+
+	speed_t speed = _baud_to_speed(mavlink_uart_baud);
+	if(speed==B0){
+		fprintf(stderr, "ERROR in %s, unsupported baud rate %d\n", __FUNCTION__, mavlink_uart_baud);
+		return -1;
+	}
+
+	fd = open(mavlink_uart, O_RDWR | O_NOCTTY | O_NONBLOCK);
+	if(fd<0){
+		perror("ERROR opening mavlink uart");
+		return -1;
+	}
+
+	// raw 8N1, no flow control
+	struct termios tio;
+	if(tcgetattr(fd, &tio)){
+		perror("ERROR in tcgetattr");
+		uart_mavlink_close();
+		return -1;
+	}
+	cfmakeraw(&tio);
+	tio.c_cflag &= ~(CSTOPB | CRTSCTS);
+	tio.c_cflag |= CLOCAL | CREAD;
+	cfsetispeed(&tio, speed);
+	cfsetospeed(&tio, speed);
+	if(tcsetattr(fd, TCSANOW, &tio)){
+		perror("ERROR in tcsetattr");
+		uart_mavlink_close();
+		return -1;
+	}
+	tcflush(fd, TCIOFLUSH);
+
+	printf("writing DISTANCE_SENSOR directly to %s at %d baud\n", mavlink_uart, mavlink_uart_baud);
+	return 0;
+}
+
+
+int uart_mavlink_is_enabled(void)
+{
+	return fd>=0;
+}
+
+
+// push out as much of the pending buffer as the uart will take right now
+static int _flush(void)
+{
+	if(n_pending==0) return 0;
+
+	ssize_t ret = write(fd, buf, n_pending);
+	if(ret<0){
+		if(errno==EAGAIN || errno==EWOULDBLOCK) return 0;
+		perror("ERROR writing to mavlink uart");
+		return -1;
+	}
+	if(ret<n_pending) memmove(buf, buf+ret, n_pending-ret);
+	n_pending -= ret;
+	return 0;
+}
+
+
+int uart_mavlink_write(mavlink_message_t* msgs, int n, int64_t sample_ns)
+{
+	if(fd<0) return -1;
+	if(n>MAX_SENSORS) n = MAX_SENSORS;
+
+	int64_t start_ns = time_monotonic_ns();
+
+	// finish the previous cycle first. If it still hasn't gone out the link
+	// is saturated and queueing more would only add latency
+	if(_flush()) return -1;
+	if(n_pending>0){
+		n_dropped += n;
+		return 0;
+	}
+
+	for(int i=0; i<n; i++){
+		n_pending += mavlink_msg_to_send_buffer(&buf[n_pending], &msgs[i]);
+	}
+	n_frames += n;
+	if(_flush()) return -1;
+
+	int64_t end_ns = time_monotonic_ns();
+	int64_t write_ns = end_ns - start_ns;
+	int64_t age_ns = end_ns - sample_ns;
+	write_ns_sum += write_ns;
+	age_ns_sum += age_ns;
+	if(write_ns>write_ns_max) write_ns_max = write_ns;
+	if(age_ns>age_ns_max) age_ns_max = age_ns;
+	n_writes++;
+
+	return 0;
+}
+
+
+void uart_mavlink_print_stats(void)
+{
+	if(fd<0 || n_writes==0) return;
+
+	printf("uart frames: %llu dropped: %llu write avg %0.3fms max %0.3fms, sample age avg %0.2fms max %0.2fms\n",
+			(unsigned long long)n_frames, (unsigned long long)n_dropped,
+			(double)write_ns_sum/n_writes/1000000.0, (double)write_ns_max/1000000.0,
+			(double)age_ns_sum/n_writes/1000000.0, (double)age_ns_max/1000000.0);
+
+	n_frames = 0;
+	n_dropped = 0;
+	write_ns_sum = 0;
+	write_ns_max = 0;
+	age_ns_sum = 0;
+	age_ns_max = 0;
+	n_writes = 0;
+	return;
+}
+
+
+void uart_mavlink_close(void)
+{
+	if(fd>=0) close(fd);
+	fd = -1;
+	n_pending = 0;
+	return;
+}
@@ -0,0 +1,299 @@
+/*******************************************************************************
+ * Copyright 2023 ModalAI Inc.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * 4. The Software is used solely in conjunction with devices provided by
+ *    ModalAI Inc.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ ******************************************************************************/
+
+
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <voxl_rangefinder_interface.h>
+#include <voxl_rangefinder_voxel.h>
+
+#include "voxel_map.h"
+#include "common.h"
+#include "config_file.h"
+#include "geometry.h"
+#include "pose.h"
+
+// cell indices are int16 in the shared layout, stay clear of the ends
+#define MAX_CELL_INDEX		32000.0f
+
+// log odds added per observation and the limits they are held to
+#define L_OCC				0.85f
+#define L_FREE				-0.4f
+#define L_MIN				-2.0f
+#define L_MAX				3.5f
+#define L_OCCUPIED			0.5f
+
+// cells with less than this much evidence left are free to reuse
+#define L_FORGOTTEN			0.05f
+
+
+static rangefinder_voxel_map_t* map = NULL;
+static size_t map_size = 0;
+static uint32_t mask = 0;
+static float inv_tau_ms = 0.0f;
+
+static uint64_t n_rays = 0;
+static uint64_t n_cells_updated = 0;
+static uint64_t n_evicted = 0;
+static uint64_t n_no_pose = 0;
+
+
+static inline float _decayed(const rangefinder_voxel_t* c, uint32_t t_ms)
+{
+	float age_ms = (float)(int32_t)(t_ms - c->t_ms);
+	if(age_ms<=0.0f) return c->log_odds;
+	return c->log_odds*expf(-age_ms*inv_tau_ms);
+}
+
+
+// Find a voxel or claim a slot for it within RANGEFINDER_VOXEL_MAX_PROBE of
+// its home, readers look voxels up the same way. Slots are
+// never emptied, only reused in place, so an empty slot ends the chain and a
+// voxel can't end up in the table twice.
+static rangefinder_voxel_t* _find_or_claim(int x, int y, int z, uint32_t t_ms)
+{
+	uint32_t home = voxl_rangefinder_voxel_hash(x, y, z);
+	rangefinder_voxel_t* victim = NULL;
+	float victim_l = 0.0f;
+
+	for(uint32_t k=0; k<RANGEFINDER_VOXEL_MAX_PROBE; k++){
+		rangefinder_voxel_t* c = &map->cell[(home+k)&mask];
+		if(!(c->flags & RANGEFINDER_VOXEL_FLAG_USED)){
+			victim = c;
+			map->n_used++;
+			goto claim;
+		}
+		if(c->x==x && c->y==y && c->z==z) return c;
+
+		// remember the cell we'd lose the least by forgetting
+		float l = fabsf(_decayed(c, t_ms));
+		if(victim==NULL || l<victim_l){
+			victim = c;
+			victim_l = l;
+		}
+	}
+	if(victim_l > L_FORGOTTEN) n_evicted++;
+
+claim:
+	victim->x = x;
+	victim->y = y;
+	victim->z = z;
+	victim->flags = RANGEFINDER_VOXEL_FLAG_USED;
+	victim->log_odds = 0.0f;
+	victim->t_ms = t_ms;
+	return victim;
+}
+
+
+static void _update_cell(int x, int y, int z, float dl, uint32_t t_ms)
+{
+	rangefinder_voxel_t* c = _find_or_claim(x, y, z, t_ms);
+	float l = _decayed(c, t_ms) + dl;
+	if(l<L_MIN) l = L_MIN;
+	if(l>L_MAX) l = L_MAX;
+	c->log_odds = l;
+	c->t_ms = t_ms;
+	n_cells_updated++;
+}
+
+
+// 3D DDA from o to h in voxel units, marking cells up to the hit as free and
+// the hit cell as occupied. At most voxel_max_ray_cells free cells are
+// touched, starting from the sensor since that's where the airframe is.
+static void _cast(const float o[3], const float h[3], uint32_t t_ms)
+{
+	int cell[3], hit[3], step[3];
+	float t_max[3], t_delta[3];
+	float d[3];
+
+	for(int k=0; k<3; k++){
+		cell[k] = (int)floorf(o[k]);
+		hit[k]  = (int)floorf(h[k]);
+		d[k] = h[k]-o[k];
+		step[k] = d[k]>0.0f ? 1 : -1;
+		if(fabsf(d[k])<1e-9f){
+			t_max[k] = INFINITY;
+			t_delta[k] = INFINITY;
+		}
+		else{
+			float next = d[k]>0.0f ? (float)(cell[k]+1) : (float)cell[k];
+			t_max[k] = (next-o[k])/d[k];
+			t_delta[k] = fabsf(1.0f/d[k]);
+		}
+	}
+
+	for(int i=0; i<voxel_max_ray_cells; i++){
+		if(cell[0]==hit[0] && cell[1]==hit[1] && cell[2]==hit[2]) break;
+		_update_cell(cell[0], cell[1], cell[2], L_FREE, t_ms);
+
+		int k = 0;
+		if(t_max[1]<t_max[k]) k = 1;
+		if(t_max[2]<t_max[k]) k = 2;
+		if(t_max[k]>1.0f) break;
+		cell[k] += step[k];
+		t_max[k] += t_delta[k];
+	}
+
+	_update_cell(hit[0], hit[1], hit[2], L_OCC, t_ms);
+}
+
+
+int voxel_map_init(void)
+{
+	if(!en_voxel_map) return 0;
+
+	if(voxel_size_m<=0.0f || voxel_decay_s<=0.0f || voxel_map_cells<RANGEFINDER_VOXEL_MAX_PROBE){
+		fprintf(stderr, "ERROR in %s, invalid voxel map config\n", __FUNCTION__);
+		return -1;
+	}
+
+	// round the table up to a power of 2 so the hash can be masked
+	uint32_t n = RANGEFINDER_VOXEL_MAX_PROBE;
+	while(n<(uint32_t)voxel_map_cells) n <<= 1;
+	mask = n-1;
+	inv_tau_ms = 1.0f/(voxel_decay_s*1000.0f);
+	map_size = voxl_rangefinder_voxel_map_size(n);
+
+	// start fresh in case a previous instance crashed and left it behind
+	shm_unlink(RANGEFINDER_VOXEL_SHM_NAME);
+	int fd = shm_open(RANGEFINDER_VOXEL_SHM_NAME, O_CREAT | O_RDWR, 0644);
+	if(fd<0){
+		perror("ERROR failed to create voxel map shared memory");
+		return -1;
+	}
+	if(ftruncate(fd, map_size)){
+		perror("ERROR failed to size voxel map shared memory");
+		close(fd);
+		return -1;
+	}
+	void* ptr = mmap(NULL, map_size, PROT_READ|PROT_WRITE, MAP_SHARED, fd, 0);
+	close(fd);
+	if(ptr==MAP_FAILED){
+		perror("ERROR failed to map voxel map shared memory");
+		return -1;
+	}
+	map = (rangefinder_voxel_map_t*)ptr;
+
+	// fill in everything before the magic number so readers never see a
+	// half-initialized header
+	memset(map, 0, map_size);
+	map->version			= RANGEFINDER_VOXEL_VERSION;
+	map->n_cells			= n;
+	map->server_pid			= getpid();
+	map->voxel_size_m		= voxel_size_m;
+	map->decay_tau_s		= voxel_decay_s;
+	map->occupied_log_odds	= L_OCCUPIED;
+	map->epoch_ns			= time_monotonic_ns();
+	__atomic_store_n(&map->magic_number, RANGEFINDER_VOXEL_MAGIC_NUMBER, __ATOMIC_RELEASE);
+
+	printf("voxel map has %u cells using %zu bytes\n", n, map_size);
+	return pose_init();
+}
+
+
+int voxel_map_update(rangefinder_sample_ext_t* s, int n)
+{
+	if(map==NULL) return 0;
+
+	int64_t t_ns = s[0].sample.timestamp_ns;
+	float T[3], R[3][3];
+	if(pose_get(t_ns, POSE_MAX_AGE_NS, T, R)){
+		n_no_pose++;
+		return 0;
+	}
+	if(t_ns < map->epoch_ns) return 0;
+	uint32_t t_ms = (uint32_t)((t_ns - map->epoch_ns)/1000000);
+	float inv_vs = 1.0f/voxel_size_m;
+
+	for(int i=0; i<n; i++){
+		if(s[i].sample.status!=RANGEFINDER_STATUS_VALID || !geom.has_dir[i]) continue;
+		float r = (float)s[i].sample.distance_mm/1000.0f;
+
+		// sensor origin and hit point in local frame, in voxel units
+		float o[3], h[3];
+		for(int k=0; k<3; k++){
+			float dk = 0.0f;
+			o[k] = T[k];
+			for(int j=0; j<3; j++){
+				o[k] += R[k][j]*geom.loc[j][i];
+				dk   += R[k][j]*geom.dir[j][i];
+			}
+			h[k] = (o[k] + r*dk)*inv_vs;
+			o[k] *= inv_vs;
+		}
+		if(fabsf(o[0])>MAX_CELL_INDEX || fabsf(o[1])>MAX_CELL_INDEX || fabsf(o[2])>MAX_CELL_INDEX) continue;
+		if(fabsf(h[0])>MAX_CELL_INDEX || fabsf(h[1])>MAX_CELL_INDEX || fabsf(h[2])>MAX_CELL_INDEX) continue;
+
+		// hold the seqlock one ray at a time so readers aren't kept out
+		// for the whole batch
+		uint32_t seq = map->seq;
+		__atomic_store_n(&map->seq, seq+1, __ATOMIC_RELAXED);
+		__atomic_thread_fence(__ATOMIC_RELEASE);
+		_cast(o, h, t_ms);
+		__atomic_store_n(&map->seq, seq+2, __ATOMIC_RELEASE);
+		n_rays++;
+	}
+	return 0;
+}
+
+
+void voxel_map_print_stats(void)
+{
+	if(map==NULL) return;
+
+	printf("voxels: %u/%u used, %llu rays %llu cell updates %llu evicted %llu without pose\n", \
+			map->n_used, map->n_cells, (unsigned long long)n_rays, \
+			(unsigned long long)n_cells_updated, (unsigned long long)n_evicted, \
+			(unsigned long long)n_no_pose);
+	n_rays = 0;
+	n_cells_updated = 0;
+	n_evicted = 0;
+	n_no_pose = 0;
+	return;
+}
+
+
+void voxel_map_cleanup(void)
+{
+	if(map==NULL) return;
+	// readers that still have it mapped check this to see it's stale
+	__atomic_store_n(&map->magic_number, 0, __ATOMIC_RELEASE);
+	munmap(map, map_size);
+	shm_unlink(RANGEFINDER_VOXEL_SHM_NAME);
+	map = NULL;
+	return;
+}
@@ -0,0 +1,132 @@
+/*******************************************************************************
+ * Copyright 2023 ModalAI Inc.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * 4. The Software is used solely in conjunction with devices provided by
+ *    ModalAI Inc.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ ******************************************************************************/
+
+
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+#include <modal_pipe_server.h>
+#include <voxl_rangefinder_interface.h>
+
+#include "world_points.h"
+#include "common.h"
+#include "config_file.h"
+#include "geometry.h"
+#include "pose.h"
+
+
+static int ch = -1;
+
+
+int world_points_init(void)
+{
+	if(!en_world_points) return 0;
+
+	ch = pipe_server_get_next_available_channel();
+
+	pipe_info_t info = { \
+		.name        = RANGEFINDER_WORLD_POINT_PIPE_NAME,\
+		.location    = RANGEFINDER_WORLD_POINT_PIPE_LOCATION ,\
+		.type        = "rangefinder_world_point_t",\
+		.server_name = PROCESS_NAME,\
+		.size_bytes  = RANGEFINDER_RECOMMENDED_PIPE_SIZE};
+
+	if(pipe_server_create(ch, info, 0)) return -1;
+	return pose_init();
+}
+
+
+int world_points_num_clients(void)
+{
+	if(ch<0) return 0;
+	return pipe_server_get_num_clients(ch);
+}
+
+
+int world_points_publish(rangefinder_sample_ext_t* s, int n)
+{
+	if(ch<0 || pipe_server_get_num_clients(ch)<=0) return 0;
+
+	int64_t t_ns = s[0].sample.timestamp_ns;
+	float T[3], R[3][3];
+	if(pose_get(t_ns, POSE_MAX_AGE_NS, T, R)) return 0;
+
+	rangefinder_world_point_t out[MAX_SENSORS];
+	int n_out = 0;
+
+	for(int i=0; i<n; i++){
+		rangefinder_sample_t* x = &s[i].sample;
+		if(x->status!=RANGEFINDER_STATUS_VALID || !geom.has_dir[i]) continue;
+
+		rangefinder_world_point_t* p = &out[n_out];
+		memset(p, 0, sizeof(rangefinder_world_point_t));
+		p->magic_number	= RANGEFINDER_WORLD_POINT_MAGIC_NUMBER;
+		p->sample_id	= x->sample_id;
+		p->timestamp_ns	= x->timestamp_ns;
+		p->sensor_id	= enabled_sensors[i].sensor_id;
+		p->distance_m	= (float)x->distance_mm/1000.0f;
+
+		// ray direction and hit point in the local frame
+		float d[3];
+		for(int k=0; k<3; k++){
+			float o = T[k];
+			d[k] = 0.0f;
+			for(int j=0; j<3; j++){
+				o    += R[k][j]*geom.loc[j][i];
+				d[k] += R[k][j]*geom.dir[j][i];
+			}
+			p->xyz[k] = o + p->distance_m*d[k];
+		}
+
+		// uncertainty_mm is 2 sigma. Across the ray treat the target as
+		// anywhere on the disc the cone covers, sigma of half its radius.
+		float sr = 0.0005f*(float)x->uncertainty_mm;
+		float sl = 0.5f*p->distance_m*tanf(geom.half_fov_rad[i]);
+		float vr = sr*sr;
+		float vl = sl*sl;
+
+		// vl*I + (vr-vl)*d*d^T
+		int m = 0;
+		for(int a=0; a<3; a++){
+			for(int b=a; b<3; b++){
+				p->cov[m] = (vr-vl)*d[a]*d[b];
+				if(a==b) p->cov[m] += vl;
+				m++;
+			}
+		}
+		n_out++;
+	}
+
+	if(n_out==0) return 0;
+	return pipe_server_write(ch, out, sizeof(rangefinder_world_point_t)*n_out);
+}
@@ -53,6 +53,7 @@ static char pipe_path[MODAL_PIPE_MAX_PATH_LEN] = RANGEFINDER_PIPE_LOCATION;
 static int en_newline = 0;
 static bool test_mode = false;
 static int test_passed = 0;
+static rangefinder_stream_parser_t parser;
 
 
 #define DISABLE_WRAP		"\033[?7l"	// disables line wrap, be sure to enable before exiting
@@ -116,12 +117,9 @@ static void _disconnect_cb(__attribute__((unused)) int ch, __attribute__((unused
 
 
 
-static void _helper_cb( __attribute__((unused)) int ch, char* data, int bytes, __attribute__((unused)) void* context)
+static void _packets_cb(rangefinder_data_t* d, int n_packets, __attribute__((unused)) void* context)
 {
-	// validate that the data makes sense
-	int n_packets, i;
-	rangefinder_data_t* d = voxl_rangefinder_validate_pipe_data(data, bytes, &n_packets);
-	if(d == NULL) return;
+	int i;
 
 	// keep track of current sample id, multiple rangefinder readings will have
 	// the same sample_id if fired together
@@ -162,6 +160,14 @@ static void _helper_cb( __attribute__((unused)) int ch, char* data, int bytes, _
 }
 
 
+static void _helper_cb( __attribute__((unused)) int ch, char* data, int bytes, __attribute__((unused)) void* context)
+{
+	// parse whatever we got, partial packets are kept for the next read
+	voxl_rangefinder_parser_feed(&parser, data, bytes, _packets_cb, NULL);
+	return;
+}
+
+
 static int _parse_opts(int argc, char* argv[])
 {
 	static struct option long_options[] =
@@ -255,6 +261,12 @@ int main(int argc, char* argv[])
 	printf("\nclosing and exiting\n");
 	pipe_client_close_all();
 
+	if(parser.n_bytes_dropped>0){
+		printf("dropped %llu bytes in %llu resyncs\n", \
+				(unsigned long long)parser.n_bytes_dropped, \
+				(unsigned long long)parser.n_resyncs);
+	}
+
 	if(test_mode){
 		if(test_passed){
 			printf("\n\nTEST PASSED\n");